@@ -84,5 +84,7 @@ AABB operator+(const glm::dvec3& offset, const AABB& bbox) {
   return bbox + offset;
 }
 
-const AABB AABB::empty = AABB::AABB(Interval::empty, Interval::empty, Interval::empty);
-const AABB AABB::universe = AABB::AABB(Interval::universe, Interval::universe, Interval::universe);
\ No newline at end of file
+// Built from literals rather than Interval::empty/universe, which live in another translation unit
+// and may not be initialized yet when these are.
+const AABB AABB::empty = AABB::AABB(Interval(+infinity, -infinity), Interval(+infinity, -infinity), Interval(+infinity, -infinity));
+const AABB AABB::universe = AABB::AABB(Interval(-infinity, +infinity), Interval(-infinity, +infinity), Interval(-infinity, +infinity));
\ No newline at end of file
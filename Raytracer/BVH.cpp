@@ -1,4 +1,6 @@
 #include "BVH.hpp"
+#include "LightBVH.hpp"
+#include "RayPacket.hpp"
 
 #include <algorithm>
 
@@ -40,6 +42,105 @@ bool BVHNode::hit(const Ray& r, Interval ray_t, HitRecord& rec) const {
   return hit_left || hit_right;
 }
 
+bool BVHNode::occluded(const Ray& r, Interval ray_t) const {
+  if (!bbox.hit(r, ray_t))
+    return false;
+
+  return left->occluded(r, ray_t) || (right != left && right->occluded(r, ray_t));
+}
+
+void BVHNode::collect_emitters(std::vector<const Hittable*>& emitters) const {
+  left->collect_emitters(emitters);
+  if (right != left) right->collect_emitters(emitters);
+}
+
+bool BVHNode::light_bounds(LightBounds& bounds) const {
+  LightBounds left_bounds, right_bounds;
+  bool left_emits = left->light_bounds(left_bounds);
+  bool right_emits = right != left && right->light_bounds(right_bounds);
+  if (!left_emits && !right_emits) return false;
+
+  bounds = LightBounds::merge(left_bounds, right_bounds); // merge() skips a side without power
+  return true;
+}
+
+namespace {
+  // Active ray lists for stream traversal, one buffer per nesting level and thread. Growing the
+  // outer vector moves the inner vectors without reallocating their storage, so the spans handed
+  // down to children stay valid.
+  thread_local std::vector<std::vector<uint32_t>> stream_levels;
+  thread_local size_t stream_depth = 0;
+
+  std::vector<uint32_t>& stream_level() {
+    if (stream_levels.size() <= stream_depth) stream_levels.resize(stream_depth + 1);
+    std::vector<uint32_t>& level = stream_levels[stream_depth];
+    level.clear();
+    return level;
+  }
+}
+
+void BVHNode::hit_stream(std::span<const Ray> rays, Interval t, std::span<HitRecord> recs, std::span<const uint32_t> active) const {
+  // Keep the rays whose current closest hit doesn't already lie before this box.
+  std::vector<uint32_t>& inside = stream_level();
+  for (uint32_t i : active)
+    if (bbox.hit(rays[i], Interval(t.min, recs[i].t)))
+      inside.push_back(i);
+
+  if (inside.empty())
+    return;
+
+  // Children may grow stream_levels, which moves the vector object but not its storage.
+  std::span<const uint32_t> list(inside);
+  ++stream_depth;
+  left->hit_stream(rays, t, recs, list);
+  if (right != left) right->hit_stream(rays, t, recs, list);
+  --stream_depth;
+}
+
+void BVHNode::occluded_stream(std::span<const Ray> rays, Interval t, std::span<uint8_t> blocked, std::span<const uint32_t> active) const {
+  std::vector<uint32_t>& inside = stream_level();
+  for (uint32_t i : active)
+    if (!blocked[i] && bbox.hit(rays[i], t))
+      inside.push_back(i);
+
+  if (inside.empty())
+    return;
+
+  std::span<const uint32_t> list(inside);
+  ++stream_depth;
+  left->occluded_stream(rays, t, blocked, list);
+  if (right != left) right->occluded_stream(rays, t, blocked, list);
+  --stream_depth;
+}
+
+void BVHNode::packet_stream(RayPacket& packet, Interval t, std::span<HitRecord> recs, uint64_t active) const {
+  // One frustum test rejects the box for the whole packet, otherwise the lanes are tested together.
+  if (!packet.frustum_hit(bbox, t))
+    return;
+  active = packet.hit_mask(bbox, t, active);
+  if (!active)
+    return;
+
+  if (right == left) {
+    left->packet_stream(packet, t, recs, active);
+    return;
+  }
+
+  // Visit the child that comes first along the packet's directions, so its hits clip the other one.
+  AABB left_box = left->bounding_box();
+  AABB right_box = right->bounding_box();
+  glm::dvec3 to_right(
+    right_box.x.min + right_box.x.max - left_box.x.min - left_box.x.max,
+    right_box.y.min + right_box.y.max - left_box.y.min - left_box.y.max,
+    right_box.z.min + right_box.z.max - left_box.z.min - left_box.z.max);
+  bool right_first = glm::dot(to_right, packet.direction_signs()) < 0.0;
+
+  const Hittable& first = right_first ? *right : *left;
+  const Hittable& second = right_first ? *left : *right;
+  first.packet_stream(packet, t, recs, active);
+  second.packet_stream(packet, t, recs, active);
+}
+
 bool BVHNode::box_compare(
   const std::shared_ptr<Hittable> a, const std::shared_ptr<Hittable> b, int axis_index
 ) {
@@ -22,8 +22,20 @@ class BVHNode : public Hittable {
 
     bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override;
 
+    bool occluded(const Ray& r, Interval ray_t) const override;
+
+    void hit_stream(std::span<const Ray> rays, Interval t, std::span<HitRecord> recs, std::span<const uint32_t> active) const override;
+
+    void occluded_stream(std::span<const Ray> rays, Interval t, std::span<uint8_t> blocked, std::span<const uint32_t> active) const override;
+
+    void packet_stream(RayPacket& packet, Interval t, std::span<HitRecord> recs, uint64_t active) const override;
+
     AABB bounding_box() const override { return bbox; };
 
+    void collect_emitters(std::vector<const Hittable*>& emitters) const override;
+
+    bool light_bounds(LightBounds& bounds) const override;
+
   private:
     std::shared_ptr<Hittable> left;
     std::shared_ptr<Hittable> right;
@@ -1,50 +1,624 @@
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <chrono>
+#include <functional>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
 #include <omp.h>
 #include <string>
+#include <typeinfo>
+#include <numeric>
+#include <unordered_map>
 
 #include "Camera.hpp"
 #include "Utilities.hpp"
 #include "Material.hpp"
 #include "PDF.hpp"
+#include "RayPacket.hpp"
 
+namespace {
+  constexpr char checkpoint_magic[8] = { 'R', 'T', 'F', 'I', 'L', 'M', '0', '2' };
 
-void Camera::render(const Hittable& world, const Hittable& lights) {
+  // Start of a checkpoint file, followed by the sum, luminance_sq and count arrays of the film,
+  // then its albedo, normal and depth sums if it has features.
+  struct CheckpointHeader {
+    char magic[8];
+    int32_t width;
+    int32_t height;
+    uint32_t seed;
+    uint32_t sampler;
+    uint32_t features;
+    uint32_t padding;
+  };
+
+  // Share of the time left before the deadline a pass may expect to take, slack for timing noise.
+  constexpr double time_budget_margin = 0.9;
+
+  double seconds_until(std::chrono::steady_clock::time_point deadline) {
+    return std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+  }
+
+  // Set by the signal handlers, polled between progressive passes.
+  volatile std::sig_atomic_t snapshot_requested = 0;
+  volatile std::sig_atomic_t stop_requested = 0;
+
+  void request_snapshot(int signal) {
+    std::signal(signal, request_snapshot); // Windows resets the handler before calling it
+    snapshot_requested = 1;
+  }
+
+  void request_stop(int signal) {
+    std::signal(signal, SIG_DFL); // A second one ends the process right away
+    stop_requested = 1;
+  }
+}
+
+void Camera::render(const Hittable& world) {
   initialize();
 
-  std::vector<glm::vec3> framebuffer(image_width * image_height);
+  LightBVH lights(world);
+  std::clog << "Sampling " << lights.size() << " light(s)" << (environment ? " and the environment map.\n" : ".\n");
+  // Like PBRT's light BVH sampler: the environment map and the BVH of emitters get half the light
+  // samples each.
+  environment_pick = !environment ? 0.0 : lights.empty() ? 1.0 : 0.5;
 
   auto start = std::chrono::high_resolution_clock::now();
+  if (streaming) {
+    linear_image.clear();
+    render_streaming(world, lights);
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    std::clog << "Done in " << elapsed.count() << " seconds.\n";
+    return;
+  }
 
-#pragma omp parallel for schedule(dynamic, 1)
-  for (int j = 0; j < image_height; ++j) {
-    for (int i = 0; i < image_width; ++i) {
-      glm::vec3 pixel_color(0, 0, 0);
-      for (int s_j = 0; s_j < sqrt_spp; ++s_j) {
-        for (int s_i = 0; s_i < sqrt_spp; ++s_i) {
-          Ray r = get_ray(i, j, s_i, s_j);
-          pixel_color += ray_color(r, max_depth, world, lights);
+  const size_t pixel_count = size_t(image_width) * image_height;
+  Film film;
+  film.allocate(pixel_count, denoise || !aov_prefix.empty());
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(time_budget));
+  if (time_budget > 0.0)
+    std::clog << "Time budget of " << time_budget << " seconds.\n";
+
+  if (adaptive_sampling) {
+    render_adaptive(world, lights, film, deadline);
+  }
+  else if (progressive || time_budget > 0.0) {
+    render_progressive(world, lights, film, deadline);
+  }
+  else {
+    std::vector<uint32_t> pixels(pixel_count);
+    std::iota(pixels.begin(), pixels.end(), 0u);
+    render_pass(world, lights, film, pixels, std::max(samples_per_pixel, 1));
+  }
+
+  ImageBuffers image = resolve(film);
+  if (!aov_prefix.empty())
+    write_aovs(image);
+  if (denoise) {
+    auto denoise_start = std::chrono::high_resolution_clock::now();
+    image.color = denoise_image(image, denoise_iterations);
+    std::chrono::duration<double> denoise_elapsed = std::chrono::high_resolution_clock::now() - denoise_start;
+    std::clog << "Denoised in " << denoise_elapsed.count() << " seconds.\n";
+  }
+
+  linear_image = std::move(image.color);
+  if (output_file.empty())
+    write_image(std::cout, image_width, image_height, linear_image, ImageFormat::ppm_ascii, tonemap, float(exposure));
+  else if (!write_image(output_file, image_width, image_height, linear_image, format_from_extension(output_file), tonemap, float(exposure)))
+    std::clog << "Could not write the image to " << output_file << ".\n";
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = end - start;
+  std::clog << "Done in " << elapsed.count() << " seconds.\n";
+
+  if (!sample_count_map.empty())
+    write_sample_count_map(film);
+}
+
+void Camera::render_pass(const Hittable& world, const LightBVH& lights, Film& film, std::span<const uint32_t> pixels, int samples) const {
+  if (wavefront)
+    render_wavefront(world, lights, film, pixels, samples);
+  else
+    render_tiles(world, lights, film, pixels, samples);
+}
+
+void Camera::render_tiles(const Hittable& world, const LightBVH& lights, Film& film, std::span<const uint32_t> pixels, int samples) const {
+  // The image is cut into tiles of tile_size pixels, handed out along tile_order by a work stealing
+  // TileScheduler. Inside a tile, primary rays are traced as packets of packet_width x packet_width
+  // pixels, one packet per sample index, and each path continues on its own from the packet's
+  // first hit. Packets, and pixels within a packet, follow a Morton curve so consecutive paths
+  // start next to each other. Pixels not listed are left out of their packets. A pixel's samples
+  // continue its sample sequence from the ones taken by earlier passes.
+  //
+  // Too few tiles can't keep every thread busy (small images, regions, single pixel references), so
+  // then the samples of each tile are split into ranges scheduled as separate work units. Each
+  // unit accumulates into its own slice of film, merged in unit order once all are done. The split
+  // depends on the image and the sample count only, never on the thread count, which keeps renders
+  // reproducible.
+  //
+  // The film may cover only a band of rows, the tiles then cover that band.
+  const size_t first_pixel = film.first_pixel;
+  const int first_row = int(first_pixel / image_width);
+  const int end_row = first_row + int(film.count.size() / image_width);
+  std::vector<uint8_t> selected(film.count.size(), 0);
+  for (uint32_t pixel : pixels)
+    selected[pixel - first_pixel] = 1;
+
+  const int packets_per_tile = std::max((tile_size + packet_width - 1) / packet_width, 1);
+  const int tile_pixels = packets_per_tile * packet_width;
+  const int tiles_x = (image_width + tile_pixels - 1) / tile_pixels;
+  const int tiles_y = (end_row - first_row + tile_pixels - 1) / tile_pixels;
+  const std::vector<uint32_t> packet_order = curve_order(packets_per_tile, packets_per_tile, TileOrder::morton);
+  const std::vector<uint32_t> lane_order = curve_order(packet_width, packet_width, TileOrder::morton);
+
+  std::vector<uint8_t> occupied(size_t(tiles_x) * tiles_y, 0);
+  for (uint32_t pixel : pixels)
+    occupied[((pixel / image_width - first_row) / tile_pixels) * tiles_x + pixel % image_width / tile_pixels] = 1;
+  const int busy_tiles = std::max(int(std::count(occupied.begin(), occupied.end(), uint8_t(1))), 1);
+  const int splits = std::clamp((min_work_units + busy_tiles - 1) / busy_tiles, 1, std::max(samples, 1));
+
+  TileScheduler scheduler(tiles_x, tiles_y, tile_order, omp_get_max_threads(), splits);
+  std::vector<Film> slices(splits > 1 ? scheduler.size() : 0);
+  int tiles_remaining = scheduler.size();
+  if (splits > 1)
+    std::clog << "Splitting the samples of every tile in " << splits << " parts.\n";
+
+#pragma omp parallel
+  {
+    Ray primary_rays[RayPacket::max_size];
+    HitRecord primary_hits[RayPacket::max_size];
+    int lane_pixels[RayPacket::max_size];
+    int lane_first_samples[RayPacket::max_size]; // Index of the pixel's first sample in this pass
+    size_t lane_slots[RayPacket::max_size];      // Where the pixel accumulates: film or slice index
+    auto pixel_sampler = make_sampler(sampler, seed);
+    IndependentSampler traversal_sampler(seed);
+
+    for (int unit; (unit = scheduler.next(omp_get_thread_num())) >= 0;) {
+      const int tile = unit / splits;
+      const int split = unit % splits;
+      const int tile_x0 = (tile % tiles_x) * tile_pixels;
+      const int tile_y0 = first_row + (tile / tiles_x) * tile_pixels;
+      const int first_sample = int(int64_t(samples) * split / splits);
+      const int end_sample = int(int64_t(samples) * (split + 1) / splits);
+
+      Film* target = &film;
+      if (splits > 1) {
+        target = &slices[unit];
+        target->allocate(size_t(tile_pixels) * tile_pixels, film.has_features());
+      }
+
+      for (uint32_t packet_index : packet_order) {
+        const int x0 = tile_x0 + int(packet_index) % packets_per_tile * packet_width;
+        const int y0 = tile_y0 + int(packet_index) / packets_per_tile * packet_width;
+
+        int lanes = 0;
+        for (uint32_t offset : lane_order) {
+          const int i = x0 + int(offset) % packet_width;
+          const int j = y0 + int(offset) / packet_width;
+          if (i >= image_width || j >= end_row) continue;
+          const size_t slot = size_t(j) * image_width + i - first_pixel;
+          if (selected[slot]) {
+            lane_pixels[lanes] = j * image_width + i;
+            lane_first_samples[lanes] = film.count[slot];
+            lane_slots[lanes] = splits > 1 ? size_t(j - tile_y0) * tile_pixels + (i - tile_x0) : slot;
+            ++lanes;
+          }
+        }
+
+        for (int s = first_sample; s < end_sample && lanes > 0; ++s) {
+          SamplerScope sampler_scope(*pixel_sampler);
+          for (int lane = 0; lane < lanes; ++lane) {
+            const int pixel = lane_pixels[lane];
+            pixel_sampler->start_pixel_sample(pixel, lane_first_samples[lane] + s);
+            primary_rays[lane] = get_ray(pixel % image_width, pixel / image_width);
+          }
+
+          // Numbers drawn while tracing the packet come from their own stream, keyed on its first pixel.
+          RayPacket packet(std::span<const Ray>(primary_rays, lanes));
+          traversal_sampler.start_pixel_sample(lane_pixels[0], lane_first_samples[0] + s, Sampler::traversal_dimensions);
+          {
+            SamplerScope traversal_scope(traversal_sampler);
+            world.hit_packet(packet, Interval(0.001, infinity), primary_hits);
+          }
+          for (int lane = 0; lane < lanes; ++lane) {
+            Features features;
+            if (film.has_features())
+              features = first_hit_features(primary_rays[lane], primary_hits[lane]);
+            pixel_sampler->start_pixel_sample(lane_pixels[lane], lane_first_samples[lane] + s, Sampler::camera_dimensions);
+            target->add(lane_slots[lane], ray_color(primary_rays[lane], world, lights, &primary_hits[lane]), features);
+          }
         }
       }
-      framebuffer[j * image_width + i] = (float)pixel_samples_scale * pixel_color;
-    }
 
 #pragma omp critical
-    {
-      std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
+      {
+        std::clog << "\rTiles remaining: " << --tiles_remaining << ' ' << std::flush;
+      }
+    }
+  }
+  std::clog << '\n';
+
+  for (size_t unit = 0; unit < slices.size(); ++unit) {
+    const int tile = int(unit) / splits;
+    const int tile_x0 = (tile % tiles_x) * tile_pixels;
+    const int tile_y0 = first_row + (tile / tiles_x) * tile_pixels;
+    for (int j = tile_y0; j < std::min(tile_y0 + tile_pixels, end_row); ++j)
+      for (int i = tile_x0; i < std::min(tile_x0 + tile_pixels, image_width); ++i)
+        film.merge(size_t(j) * image_width + i - first_pixel, slices[unit], size_t(j - tile_y0) * tile_pixels + (i - tile_x0));
+  }
+}
+
+void Camera::render_adaptive(const Hittable& world, const LightBVH& lights, Film& film, std::chrono::steady_clock::time_point deadline) const {
+  // Every pixel takes adaptive_min_samples samples, then passes of as many again go to the pixels
+  // whose error is still above adaptive_threshold, until none is left or samples_per_pixel samples
+  // per pixel on average are spent. Pixels stop at adaptive_max_samples; when the budget left
+  // can't afford a pass over all the noisy pixels, the noisiest ones get it.
+  // Stopping on an estimated error is slightly biased: a pixel whose first samples all missed its
+  // rare bright paths looks converged and stays too dark. adaptive_min_samples bounds the effect.
+  // With a time budget, the budget left is also capped by the samples the measured throughput
+  // affords before the deadline.
+  const int pass_samples = std::max(adaptive_min_samples, 1);
+  const int max_samples = adaptive_max_samples > 0 ? adaptive_max_samples : 4 * samples_per_pixel;
+  size_t budget = film.count.size() * size_t(std::max(samples_per_pixel, 0));
+
+  std::vector<uint32_t> active(film.count.size());
+  std::iota(active.begin(), active.end(), 0u);
+  std::vector<std::pair<double, uint32_t>> noisy;
+  double pass_seconds = 0.0;
+  size_t samples_taken = 0;
+
+  for (int pass = 1; !active.empty(); ++pass) {
+    std::clog << "Pass " << pass << ": sampling " << active.size() << " pixel(s).\n";
+    const auto pass_start = std::chrono::steady_clock::now();
+    render_pass(world, lights, film, active, pass_samples);
+    pass_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - pass_start).count();
+    samples_taken += active.size() * pass_samples;
+    budget -= std::min(budget, active.size() * pass_samples);
+
+    if (time_budget > 0.0) {
+      // A pass can finish within the clock's resolution, keep the estimate away from 0.
+      const double seconds_per_sample = std::max(pass_seconds, 1e-9) / samples_taken;
+      const size_t affordable_in_time = size_t(std::max(time_budget_margin * seconds_until(deadline), 0.0) / seconds_per_sample);
+      if (affordable_in_time <= budget) {
+        budget = affordable_in_time;
+        if (budget < size_t(pass_samples))
+          std::clog << "Time budget spent.\n";
+      }
+    }
+
+    noisy.clear();
+    for (uint32_t pixel : active) {
+      if (film.count[pixel] + pass_samples > max_samples) continue;
+      double error = film.error(pixel);
+      if (error > adaptive_threshold) noisy.emplace_back(error, pixel);
     }
+
+    size_t affordable = budget / pass_samples;
+    if (noisy.size() > affordable) {
+      std::nth_element(noisy.begin(), noisy.begin() + affordable, noisy.end(), std::greater<>());
+      noisy.resize(affordable);
+    }
+
+    // Back in scanline order, so the next pass still traces neighbouring pixels together.
+    active.clear();
+    for (const auto& [error, pixel] : noisy)
+      active.push_back(pixel);
+    std::sort(active.begin(), active.end());
   }
+}
+
+void Camera::render_progressive(const Hittable& world, const LightBVH& lights, Film& film, std::chrono::steady_clock::time_point deadline) const {
+  // Every pass takes the next progressive_pass_samples samples of all pixels. Sample values don't
+  // depend on threads or on when the render was interrupted, and passes start at the same sample
+  // counts, so a resumed render outputs the same image as an uninterrupted one.
+  // With a time budget, the first pass takes a single sample to measure the throughput and later
+  // passes shrink to what still fits before the deadline.
+  if (!checkpoint_file.empty() && load_checkpoint(film))
+    std::clog << "Resuming from " << checkpoint_file << ".\n";
+
+  const int target = std::max(samples_per_pixel, 1);
+  const int pass_samples = std::max(progressive_pass_samples, 1);
+  std::vector<uint32_t> pixels(film.count.size());
+  std::iota(pixels.begin(), pixels.end(), 0u);
+
+  snapshot_requested = 0;
+  stop_requested = 0;
+  auto previous_int = std::signal(SIGINT, request_stop);
+  auto previous_term = std::signal(SIGTERM, request_stop);
+#if defined(SIGUSR1)
+  auto previous_snapshot = std::signal(SIGUSR1, request_snapshot);
+#elif defined(SIGBREAK)
+  auto previous_snapshot = std::signal(SIGBREAK, request_snapshot);
+#endif
 
-  std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
-  for (int j = 0; j < image_height; ++j) {
-    for (int i = 0; i < image_width; ++i) {
-      write_color(std::cout, framebuffer[j * image_width + i]);
+  const bool budgeted = time_budget > 0.0;
+  double pass_seconds = 0.0;
+  int samples_taken = 0;
+
+  auto last_checkpoint = std::chrono::steady_clock::now();
+  int done = *std::min_element(film.count.begin(), film.count.end());
+  while (done < target) {
+    int samples = std::min(pass_samples, target - done);
+    if (budgeted && samples_taken == 0)
+      samples = 1;
+    else if (budgeted)
+      // Clamped before the conversion, a pass timed at 0 seconds would make the estimate infinite.
+      samples = int(std::clamp(time_budget_margin * seconds_until(deadline) * samples_taken / std::max(pass_seconds, 1e-9), 1.0, double(samples)));
+
+    std::clog << "Samples " << done << " to " << done + samples << " of " << target << ".\n";
+    const auto pass_start = std::chrono::steady_clock::now();
+    render_pass(world, lights, film, pixels, samples);
+    pass_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - pass_start).count();
+    samples_taken += samples;
+    done += samples;
+
+    // Out of time once even a single sample per pixel would overrun the deadline.
+    const bool out_of_time = budgeted && time_budget_margin * seconds_until(deadline) < pass_seconds / samples_taken;
+
+    if (snapshot_requested) {
+      snapshot_requested = 0;
+      bool written = write_image(snapshot_file, image_width, image_height, resolve(film).color, format_from_extension(snapshot_file), tonemap, float(exposure));
+      std::clog << (written ? "Snapshot written to " : "Could not write the snapshot to ") << snapshot_file << ".\n";
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    const bool due = std::chrono::duration<double>(now - last_checkpoint).count() >= checkpoint_interval;
+    if (!checkpoint_file.empty() && (due || stop_requested || out_of_time || done == target)) {
+      if (save_checkpoint(film))
+        std::clog << "Checkpoint written to " << checkpoint_file << " at " << done << " samples per pixel.\n";
+      last_checkpoint = now;
+    }
+
+    if (stop_requested) {
+      std::clog << "Stopped at " << done << " samples per pixel.\n";
+      break;
+    }
+    if (out_of_time && done < target) {
+      std::clog << "Time budget spent at " << done << " samples per pixel.\n";
+      break;
     }
   }
-  auto end = std::chrono::high_resolution_clock::now();
-  std::chrono::duration<double> elapsed = end - start;
-  std::clog << "\nDone in " << elapsed.count() << " seconds.\n";
+
+  std::signal(SIGINT, previous_int);
+  std::signal(SIGTERM, previous_term);
+#if defined(SIGUSR1)
+  std::signal(SIGUSR1, previous_snapshot);
+#elif defined(SIGBREAK)
+  std::signal(SIGBREAK, previous_snapshot);
+#endif
+}
+
+void Camera::render_streaming(const Hittable& world, const LightBVH& lights) const {
+  // Bands are whole rows of tiles on the image's tile grid, so render_tiles cuts them the way it
+  // would cut the whole image. Only the band's film and its resolved rows are in memory at a time.
+  if (denoise || !aov_prefix.empty() || adaptive_sampling || progressive || time_budget > 0.0 || !sample_count_map.empty())
+    std::clog << "Streaming ignores denoising, AOVs, adaptive sampling, progressive rendering, the time budget and the sample count map.\n";
+
+  std::ofstream file;
+  if (!output_file.empty()) {
+    file.open(output_file, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      std::clog << "Could not write the image to " << output_file << ".\n";
+      return;
+    }
+  }
+  const ImageFormat format = output_file.empty() ? ImageFormat::ppm_ascii : format_from_extension(output_file);
+  ImageStream stream(output_file.empty() ? std::cout : file, image_width, image_height, format, tonemap, float(exposure));
+
+  const int tile_pixels = std::max((tile_size + packet_width - 1) / packet_width, 1) * packet_width;
+  const int band_rows = std::max((stream_band_rows + tile_pixels - 1) / tile_pixels, 1) * tile_pixels;
+  const int bands = (image_height + band_rows - 1) / band_rows;
+
+  Film film;
+  std::vector<uint32_t> pixels;
+  for (int b = 0; b < bands; ++b) {
+    const int band = stream.bottom_up() ? bands - 1 - b : b;
+    const int first_row = band * band_rows;
+    const int rows = std::min(band_rows, image_height - first_row);
+    film.allocate(size_t(rows) * image_width, false);
+    film.first_pixel = size_t(first_row) * image_width;
+    pixels.resize(film.count.size());
+    std::iota(pixels.begin(), pixels.end(), uint32_t(film.first_pixel));
+
+    render_pass(world, lights, film, pixels, std::max(samples_per_pixel, 1));
+    if (!stream.write_rows(resolve(film).color)) {
+      std::clog << "Could not write the image to " << (output_file.empty() ? "stdout" : output_file) << ".\n";
+      return;
+    }
+    std::clog << "Rows " << first_row << " to " << first_row + rows - 1 << " written, band " << b + 1 << " of " << bands << ".\n";
+  }
+  stream.finish();
+}
+
+ImageBuffers Camera::resolve(const Film& film) const {
+  const size_t pixel_count = film.count.size();
+  ImageBuffers image;
+  image.width = image_width;
+  image.height = int(pixel_count / image_width);
+  image.color.resize(pixel_count);
+  image.variance.resize(pixel_count);
+  for (size_t p = 0; p < pixel_count; ++p) {
+    image.color[p] = film.mean(p);
+    image.variance[p] = float(film.variance(p));
+  }
+
+  if (film.has_features()) {
+    image.albedo.resize(pixel_count);
+    image.normal.resize(pixel_count);
+    image.depth.resize(pixel_count);
+    for (size_t p = 0; p < pixel_count; ++p) {
+      const float scale = film.count[p] > 0 ? 1.0f / film.count[p] : 0.0f;
+      image.albedo[p] = film.albedo[p] * scale;
+      image.normal[p] = film.normal[p] * scale;
+      image.depth[p] = film.depth[p] * scale;
+    }
+  }
+  return image;
+}
+
+void Camera::write_aovs(const ImageBuffers& image) const {
+  // As PFM, values untouched: normals in [-1, 1], depth in scene units, variance of the mean
+  // luminance in every channel.
+  auto write = [&](const char* name, const std::vector<glm::vec3>& values) {
+    const std::string path = aov_prefix + "_" + name + ".pfm";
+    bool written = write_image(path, image_width, image_height, values, ImageFormat::pfm);
+    std::clog << (written ? "AOV written to " : "Could not write the AOV to ") << path << ".\n";
+  };
+  auto gray = [](const std::vector<float>& values) {
+    return std::vector<glm::vec3>(values.begin(), values.end());
+  };
+  write("albedo", image.albedo);
+  write("normal", image.normal);
+  write("depth", gray(image.depth));
+  write("variance", gray(image.variance));
+}
+
+bool Camera::save_checkpoint(const Film& film) const {
+  // Written next to the checkpoint then renamed over it, so a crash while writing leaves the
+  // previous checkpoint intact.
+  CheckpointHeader header = {};
+  std::memcpy(header.magic, checkpoint_magic, sizeof(checkpoint_magic));
+  header.width = image_width;
+  header.height = image_height;
+  header.seed = seed;
+  header.sampler = static_cast<uint32_t>(sampler);
+  header.features = film.has_features() ? 1 : 0;
+
+  const std::string temporary = checkpoint_file + ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(film.sum.data()), film.sum.size() * sizeof(glm::vec3));
+    out.write(reinterpret_cast<const char*>(film.luminance_sq.data()), film.luminance_sq.size() * sizeof(double));
+    out.write(reinterpret_cast<const char*>(film.count.data()), film.count.size() * sizeof(int));
+    out.write(reinterpret_cast<const char*>(film.albedo.data()), film.albedo.size() * sizeof(glm::vec3));
+    out.write(reinterpret_cast<const char*>(film.normal.data()), film.normal.size() * sizeof(glm::vec3));
+    out.write(reinterpret_cast<const char*>(film.depth.data()), film.depth.size() * sizeof(float));
+    if (!out) {
+      std::clog << "Could not write the checkpoint to " << temporary << ".\n";
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporary, checkpoint_file, error);
+  if (error) {
+    std::clog << "Could not replace " << checkpoint_file << ": " << error.message() << ".\n";
+    return false;
+  }
+  return true;
+}
+
+bool Camera::load_checkpoint(Film& film) const {
+  std::ifstream in(checkpoint_file, std::ios::binary);
+  if (!in) return false;
+
+  CheckpointHeader header;
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, checkpoint_magic, sizeof(checkpoint_magic)) != 0) {
+    std::clog << checkpoint_file << " is not a checkpoint, starting over.\n";
+    return false;
+  }
+  if (header.width != image_width || header.height != image_height || header.seed != seed || header.sampler != static_cast<uint32_t>(sampler)) {
+    std::clog << checkpoint_file << " was rendered with another resolution, seed or sampler, starting over.\n";
+    return false;
+  }
+  if (film.has_features() && !header.features) {
+    std::clog << checkpoint_file << " has no denoising features, starting over.\n";
+    return false;
+  }
+
+  Film loaded = film;
+  in.read(reinterpret_cast<char*>(loaded.sum.data()), loaded.sum.size() * sizeof(glm::vec3));
+  in.read(reinterpret_cast<char*>(loaded.luminance_sq.data()), loaded.luminance_sq.size() * sizeof(double));
+  in.read(reinterpret_cast<char*>(loaded.count.data()), loaded.count.size() * sizeof(int));
+  in.read(reinterpret_cast<char*>(loaded.albedo.data()), loaded.albedo.size() * sizeof(glm::vec3));
+  in.read(reinterpret_cast<char*>(loaded.normal.data()), loaded.normal.size() * sizeof(glm::vec3));
+  in.read(reinterpret_cast<char*>(loaded.depth.data()), loaded.depth.size() * sizeof(float));
+  if (!in) {
+    std::clog << checkpoint_file << " is truncated, starting over.\n";
+    return false;
+  }
+  film = std::move(loaded);
+  return true;
+}
+
+void Camera::write_sample_count_map(const Film& film) const {
+  // Grayscale, white for the pixels that took the most samples.
+  std::ofstream file(sample_count_map);
+  if (!file) {
+    std::clog << "Could not write the sample count map to " << sample_count_map << ".\n";
+    return;
+  }
+
+  const auto [fewest, most] = std::minmax_element(film.count.begin(), film.count.end());
+  file << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+  for (int count : film.count) {
+    int level = int(255.0 * count / std::max(*most, 1));
+    file << level << ' ' << level << ' ' << level << '\n';
+  }
+
+  size_t total = std::accumulate(film.count.begin(), film.count.end(), size_t(0));
+  std::clog << "Sample counts written to " << sample_count_map << ": " << *fewest << " to " << *most
+            << " per pixel, " << double(total) / film.count.size() << " on average.\n";
+}
+
+void Camera::Film::allocate(size_t pixels, bool features) {
+  sum.assign(pixels, glm::vec3(0.0f));
+  luminance_sq.assign(pixels, 0.0);
+  count.assign(pixels, 0);
+  albedo.assign(features ? pixels : 0, glm::vec3(0.0f));
+  normal.assign(features ? pixels : 0, glm::vec3(0.0f));
+  depth.assign(features ? pixels : 0, 0.0f);
+}
+
+void Camera::Film::add(size_t pixel, const glm::vec3& radiance, const Features& features) {
+  double y = luminance(radiance);
+  sum[pixel] += radiance;
+  luminance_sq[pixel] += y * y;
+  ++count[pixel];
+  if (has_features()) {
+    albedo[pixel] += features.albedo;
+    normal[pixel] += features.normal;
+    depth[pixel] += features.depth;
+  }
+}
+
+void Camera::Film::merge(size_t pixel, const Film& slice, size_t slice_pixel) {
+  sum[pixel] += slice.sum[slice_pixel];
+  luminance_sq[pixel] += slice.luminance_sq[slice_pixel];
+  count[pixel] += slice.count[slice_pixel];
+  if (has_features()) {
+    albedo[pixel] += slice.albedo[slice_pixel];
+    normal[pixel] += slice.normal[slice_pixel];
+    depth[pixel] += slice.depth[slice_pixel];
+  }
+}
+
+glm::vec3 Camera::Film::mean(size_t pixel) const {
+  return count[pixel] > 0 ? sum[pixel] / float(count[pixel]) : glm::vec3(0.0f);
+}
+
+double Camera::Film::error(size_t pixel) const {
+  // Standard error of the pixel's mean luminance, carried through the gamma 2 of to_display()
+  // (d sqrt(y) = dy / 2 sqrt(y)) so it reads on the displayed [0, 1] scale, where dark pixels
+  // show noise the most. Pixels confidently above 1 clip to white whatever their noise.
+  const int n = count[pixel];
+  if (n < 2) return infinity;
+
+  double mean = luminance(sum[pixel]) / n;
+  double std_error = std::sqrt(variance(pixel));
+  if (mean - 2.0 * std_error > 1.0) return 0.0;
+  return std_error / (2.0 * std::sqrt(std::max(mean, 1e-4)));
+}
+
+double Camera::Film::variance(size_t pixel) const {
+  const int n = count[pixel];
+  if (n < 2) return 0.0;
+
+  double mean = luminance(sum[pixel]) / n;
+  return std::max(0.0, (luminance_sq[pixel] - n * mean * mean) / (n - 1)) / n;
 }
 
 void Camera::initialize() {
@@ -52,10 +626,6 @@ void Camera::initialize() {
   image_height = int(image_width / aspect_ratio);
   image_height = (image_height < 1) ? 1 : image_height;
 
-  sqrt_spp = int(std::sqrt(samples_per_pixel));
-  pixel_samples_scale = 1.0 / (sqrt_spp * sqrt_spp);
-  recip_sqrt_spp = 1.0 / sqrt_spp;
-
   center = look_from; // Set the camera position at the origin
 
   // Determine the viewport dimensions.
@@ -88,16 +658,18 @@ void Camera::initialize() {
   defocus_disk_v = defocus_radius * v; // Vertical defocus vector
 }
 
-Ray Camera::get_ray(int i, int j, int s_i, int s_j) const {
+Ray Camera::get_ray(int i, int j) const {
   // Construct a camera ray originating from the defocus disk and directed at a randomly
-  // sampled point around the pixel location i, j for stratified sample square s_i, s_j.
+  // sampled point around the pixel location i, j. Always draws the same dimensions, pixel
+  // position, lens position and time, so the path after it starts on a fixed dimension.
 
-  glm::dvec3 offset = sample_square_stratified(s_i, s_j);
+  glm::dvec3 offset = sample_square();
   glm::dvec3 pixel_sample = pixel00_loc
     + ((i + offset.x) * pixel_delta_u)
     + ((j + offset.y) * pixel_delta_v);
 
-  glm::dvec3 ray_origin = (defocus_angle <= 0.0) ? center : defocus_disk_sample();
+  glm::dvec2 lens_u = random_double_2d();
+  glm::dvec3 ray_origin = (defocus_angle <= 0.0) ? center : defocus_disk_sample(lens_u.x, lens_u.y);
   glm::dvec3 ray_direction = pixel_sample - ray_origin;
   double ray_time = random_double();
 
@@ -107,66 +679,544 @@ Ray Camera::get_ray(int i, int j, int s_i, int s_j) const {
 
 glm::dvec3 Camera::sample_square() const {
   //Returns the vector to a random point in the [-0.5,-0.5]-[+0.5,+0.5] square.
-  return glm::dvec3(random_double() - 0.5, random_double() - 0.5, 0.0);
+  glm::dvec2 u = random_double_2d();
+  return glm::dvec3(u.x - 0.5, u.y - 0.5, 0.0);
 }
 
-glm::dvec3 Camera::sample_square_stratified(int i, int j) const
-{
-  // Returns the vector to a random point in the square sub-pixel specified by grid
-  // indices s_i and s_j, for an idealized unit square pixel [-.5,-.5] to [+.5,+.5].
+Camera::Features Camera::first_hit_features(const Ray& ray, const HitRecord& rec) const {
+  // Camera rays that escape keep zero normal and depth, with the background as albedo.
+  Features features;
+  if (!rec.prim) {
+    features.albedo = glm::clamp(environment ? environment->radiance(ray.direction()) : background, 0.0f, 1.0f);
+    return features;
+  }
+  features.albedo = glm::clamp(rec.material->surface_albedo(rec), 0.0f, 1.0f);
+  features.normal = glm::vec3(rec.normal);
+  features.depth = float(rec.t * glm::length(ray.direction()));
+  return features;
+}
 
-  auto px = ((i + random_double()) * recip_sqrt_spp) - 0.5;
-  auto py = ((j + random_double()) * recip_sqrt_spp) - 0.5;
+glm::vec3 Camera::ray_color(const Ray& primary_ray, const Hittable& world, const LightBVH& lights, const HitRecord* primary_hit) const {
+  // Iterative path tracer with next-event estimation. Instead of recursing per bounce we carry the
+  // path throughput, the product of attenuation * scattering_pdf / pdf of every bounce so far.
+  //
+  // Every diffuse vertex takes two samples of direct light, combined with the power heuristic:
+  // - one direction towards a light picked by the light BVH, traced right away as a shadow ray;
+  // - the BSDF sampled direction the path continues with. If it lands on an emitter, its
+  //   emission is weighted against the density the light sampler would have had for it.
+  // Specular vertices (skip_pdf) can't be reached by light sampling, so emission seen through
+  // them, or straight from the camera, keeps its full weight.
+  //
+  // primary_hit, if given, is the already resolved closest hit of primary_ray (prim == nullptr for
+  // a miss), e.g. from a packet of camera rays.
+  glm::vec3 radiance(0.0f);
+  PathState path;
+  path.ray = primary_ray;
 
-  return glm::dvec3(px, py, 0);
-}
+  for (int depth = 0; depth < max_depth; ++depth) {
+    HitRecord hit_record;
+    bool found;
+    if (depth == 0 && primary_hit) {
+      hit_record = *primary_hit;
+      found = hit_record.prim != nullptr;
+    }
+    else {
+      // Add a small delta to the interval to avoid self-intersection (shadow acne)
+      found = world.hit(path.ray, Interval(0.001, infinity), hit_record);
+      if (found) hit_record.prim->surface_interaction(path.ray, hit_record);
+    }
 
-glm::vec3 Camera::ray_color(const Ray& ray, int depth, const Hittable& world, const Hittable& lights) const {
-  // If we've exceeded the ray bounce limit, no more light is gathered.
-  if(depth <= 0) {
-    return glm::vec3(0.0f); // Return black color
+    if (!found) {
+      // If the ray does not hit anything, gather the background color
+      radiance += path.throughput * escaped_radiance(path.ray, path.bsdf_pdf, path.specular_bounce);
+      break;
+    }
+
+    LightSample light_sample;
+    bool alive = shade(path, hit_record, lights, depth, radiance, light_sample);
+
+    // The light sample only counts if the first thing its shadow ray hits is the sampled light itself,
+    // or nothing at all for the environment map, where an any-hit query is enough.
+    HitRecord light_record;
+    if (light_sample.environment) {
+      if (!world.occluded(light_sample.ray, Interval(0.001, infinity)))
+        radiance += light_sample.weight;
+    }
+    else if (light_sample.light && world.hit(light_sample.ray, Interval(0.001, infinity), light_record) && light_record.prim == light_sample.light) {
+      light_record.prim->surface_interaction(light_sample.ray, light_record);
+      radiance += light_sample.weight * light_record.material->emitted(light_sample.ray, light_record, light_record.u, light_record.v, light_record.p);
+    }
+
+    if (!alive)
+      break;
   }
 
-  HitRecord hit_record;
-  // Add a small delta to the interval to avoid self-intersection (shadow acne)
-  if (!world.hit(ray, Interval(0.001, infinity), hit_record)) {
-    // If the ray does not hit anything, return the background color
-    //std::cout << "Ray missed world! Origin: " << std::to_string(ray.origin().x) << ", " << std::to_string(ray.origin().y) << "," << std::to_string(ray.origin().z)
-    //  << ", dir: " << std::to_string(ray.direction().x) << "," << std::to_string(ray.direction().y) << "," << std::to_string(ray.direction().z) <<"\n";
+  return radiance;
+}
 
+glm::vec3 Camera::escaped_radiance(const Ray& ray, double bsdf_pdf, bool specular_bounce) const {
+  // Light from beyond the scene: the background color, or the environment map, weighted against
+  // light sampling having picked the same direction unless a specular vertex (or the camera) sent
+  // the ray.
+  if (!environment)
     return background;
+  const glm::vec3 radiance = environment->radiance(ray.direction());
+  if (specular_bounce)
+    return radiance;
+  return radiance * float(power_heuristic(bsdf_pdf, environment_pick * environment->pdf(ray.direction())));
+}
+
+bool Camera::shade(PathState& path, const HitRecord& hit_record, const LightBVH& lights, int depth, glm::vec3& radiance, LightSample& light_sample) const {
+  // One vertex of a path, shared by both backends: adds the emission found at hit_record, picks a
+  // light sample for the caller to shadow test, and continues the path with a BSDF sample.
+  // Returns false when the path ends here.
+  const Ray ray = path.ray;
+
+  glm::vec3 emitted_color = hit_record.material->emitted(ray, hit_record, hit_record.u, hit_record.v, hit_record.p);
+  if (emitted_color != glm::vec3(0.0f)) {
+    // The light pdf is only needed, and only paid for, when a BSDF sample actually finds light.
+    double weight = path.specular_bounce ? 1.0 : power_heuristic(path.bsdf_pdf, (1.0 - environment_pick) * lights.pdf(path.previous_p, ray.direction(), hit_record.prim));
+    radiance += path.throughput * emitted_color * (float)weight;
   }
 
   ScatterRecord scatter_record;
-  glm::vec3 emitted_color = hit_record.material->emitted(ray, hit_record, hit_record.u, hit_record.v, hit_record.p);
+  if (!hit_record.material->scatter(ray, hit_record, scatter_record))
+    return false; // Absorbed, or a light that doesn't scatter
 
-  if(!hit_record.material->scatter(ray, hit_record, scatter_record)) {
-    // If the material scatters the ray, recursively calculate the color
-    return emitted_color;
+  if (scatter_record.skip_pdf) {
+    path.throughput *= scatter_record.attenuation;
+    path.ray = scatter_record.skip_pdf_ray;
+    path.specular_bounce = true;
   }
+  else {
+    const PDF& material_pdf = *scatter_record.pdf_ptr();
 
-  if (scatter_record.skip_pdf) {
-    return scatter_record.attenuation * ray_color(scatter_record.skip_pdf_ray, depth - 1, world, lights);
+    // Light sample, weighted against the chance of the BSDF sampling the same direction. With an
+    // environment map, it is picked first with probability environment_pick, the BVH otherwise.
+    Ray light_ray;
+    double light_pdf_value = 0.0;
+    const Hittable* light = nullptr;
+    glm::vec3 light_radiance(1.0f); // Known up front for the environment map, found by the shadow ray for emitters
+    if (environment_pick > 0.0 && (environment_pick >= 1.0 || random_double() < environment_pick)) {
+      glm::dvec2 u = random_double_2d();
+      double direction_pdf;
+      light_ray = Ray(hit_record.p, environment->sample(u.x, u.y, direction_pdf), ray.time());
+      light_pdf_value = environment_pick * direction_pdf;
+      light_radiance = environment->radiance(light_ray.direction());
+    }
+    else {
+      double light_pmf;
+      light = lights.sample(hit_record.p, light_pmf);
+      if (light) {
+        double light_direction_pdf;
+        light_ray = Ray(hit_record.p, light->sample_direction(hit_record.p, light_direction_pdf), ray.time());
+        light_pdf_value = (1.0 - environment_pick) * light_pmf * light_direction_pdf;
+      }
+    }
+    if (light_pdf_value > 0.0) {
+      double scattering_pdf = hit_record.material->scattering_pdf(ray, hit_record, light_ray);
+      if (scattering_pdf > 0.0) {
+        double weight = power_heuristic(light_pdf_value, material_pdf.value(light_ray.direction()));
+        light_sample.ray = light_ray;
+        light_sample.light = light;
+        light_sample.environment = light == nullptr;
+        light_sample.weight = path.throughput * scatter_record.attenuation * light_radiance * (float)(scattering_pdf * weight / light_pdf_value);
+      }
+    }
+
+    // BSDF sample, continues the path.
+    Ray scattered_ray = Ray(hit_record.p, material_pdf.generate(), ray.time());
+    path.bsdf_pdf = material_pdf.value(scattered_ray.direction());
+    if (path.bsdf_pdf < 1e-6) return false; // Avoids singularities
+
+    double scattering_pdf = hit_record.material->scattering_pdf(ray, hit_record, scattered_ray);
+    path.throughput *= scatter_record.attenuation * (float)(scattering_pdf / path.bsdf_pdf);
+    path.previous_p = hit_record.p;
+    path.ray = scattered_ray;
+    path.specular_bounce = false;
+  }
+
+  // Russian roulette: past russian_roulette_depth, continue with a probability proportional to
+  // the throughput and divide the survivors by it, which keeps the estimator unbiased.
+  if (depth + 1 >= russian_roulette_depth) {
+    float survival = std::min(1.0f, std::max({ path.throughput.x, path.throughput.y, path.throughput.z }));
+    if (random_double() >= survival)
+      return false;
+    path.throughput /= survival;
+  }
+
+  return true;
+}
+
+namespace {
+  // Stable LSD radix sort of values[0, count) by their bits [32, 62), in three passes of 10 bits.
+  // The low 32 bits are a payload that rides along.
+  void radix_sort_high_bits(std::vector<uint64_t>& values, std::vector<uint64_t>& scratch, size_t count) {
+    scratch.resize(values.size());
+    for (int shift = 32; shift < 62; shift += 10) {
+      std::vector<size_t> offsets(1024, 0);
+      for (size_t i = 0; i < count; ++i)
+        ++offsets[(values[i] >> shift) & 1023];
+      size_t sum = 0;
+      for (size_t& offset : offsets) {
+        size_t bucket = offset;
+        offset = sum;
+        sum += bucket;
+      }
+      for (size_t i = 0; i < count; ++i)
+        scratch[offsets[(values[i] >> shift) & 1023]++] = values[i];
+      values.swap(scratch);
+    }
   }
+}
+
+void Camera::render_wavefront(const Hittable& world, const LightBVH& lights, Film& film, std::span<const uint32_t> pixels, int pixel_samples) const {
+  // Wavefront path tracing ("Megakernels Considered Harmful", Laine, Karras & Aila 2013). Rather
+  // than following one path to its end before starting the next, a batch of wavefront_size paths
+  // advances one bounce at a time through separate stages:
+  //   generate   camera rays for every sample of the batch;
+  //   intersect  all live rays with hit_batch(), in chunks spread over the threads. Camera rays
+  //              go through hit_packet() instead, 64 consecutive samples of a pixel at a time;
+  //              Secondary rays are binned by direction octant and origin Morton code first
+  //              (sort_secondary_rays), so neighbouring rays in a chunk visit the same BVH nodes;
+  //   sort       the hits by material type and instance, misses take the background and end;
+  //   shade      the sorted hits with shade(), queueing light samples;
+  //   shadow     test the queued light samples with hit_batch() and add what reaches the light.
+  // Path state lives in structure of arrays buffers and live paths are compacted after every
+  // bounce, so each stage streams over just the fields it needs and keeps its own code hot,
+  // instead of interleaving traversal, textures and virtual material calls per ray.
+  const size_t total_samples = pixels.size() * pixel_samples;
+  const size_t batch_size = std::min<size_t>(std::max(wavefront_size, 1), total_samples);
+  constexpr int chunk_size = 1024; // Rays per hit_batch() call
+
+  // Path state, indexed by slot. Live paths occupy the first active slots.
+  std::vector<Ray> rays(batch_size);
+  std::vector<HitRecord> hits(batch_size);
+  std::vector<glm::vec3> throughputs(batch_size);
+  std::vector<glm::dvec3> previous_ps(batch_size);
+  std::vector<double> bsdf_pdfs(batch_size);
+  std::vector<uint8_t> specular_bounces(batch_size);
+  std::vector<uint8_t> alive(batch_size);
+  std::vector<uint32_t> samples(batch_size); // Sample of the batch the path belongs to
+  std::vector<uint32_t> dimensions(batch_size); // Next sampler dimension of the path
+
+  std::vector<glm::vec3> radiance(batch_size); // Indexed by sample, not by slot
+  std::vector<Features> features(film.has_features() ? batch_size : 0); // Indexed by sample
+
+  // Shadow queue, at most one light sample per shaded path. Samples of the environment map move to
+  // their own queue, which only needs an any-hit query.
+  std::vector<Ray> shadow_rays(batch_size);
+  std::vector<HitRecord> shadow_hits(batch_size);
+  std::vector<const Hittable*> shadow_lights(batch_size);
+  std::vector<uint8_t> shadow_environment(batch_size); // The shadow ray samples the environment map
+  std::vector<glm::vec3> shadow_weights(batch_size);
+  std::vector<uint32_t> shadow_samples(batch_size);
+  std::vector<Ray> environment_rays(environment ? batch_size : 0);
+  std::vector<uint8_t> environment_blocked(environment ? batch_size : 0);
+  std::vector<glm::vec3> environment_weights(environment ? batch_size : 0);
+  std::vector<uint32_t> environment_samples(environment ? batch_size : 0);
+
+  // Shading order. Materials get an id the first time a batch hits them and a rank ordering them
+  // by dynamic type, then instance, so a counting sort over the ranks groups the hits by material.
+  std::unordered_map<const Material*, uint32_t> material_ids;
+  std::vector<const Material*> materials; // Indexed by id
+  std::vector<uint32_t> material_ranks;   // Indexed by id
+  std::vector<uint32_t> hit_ids(batch_size);
+  std::vector<uint32_t> bucket_starts;
+  std::vector<uint32_t> order(batch_size);
+
+  // Secondary ray binning: key = direction octant, then Morton code of the origin in the scene
+  // bounds (9 bits per axis), sorted along with the ray's slot in the low 32 bits.
+  std::vector<uint64_t> sort_keys(batch_size);
+  std::vector<uint64_t> sort_scratch;
+  std::vector<Ray> sorted_rays(sort_secondary_rays ? batch_size : 0);
+  std::vector<HitRecord> sorted_hits(sort_secondary_rays ? batch_size : 0);
+  std::vector<uint32_t> sorted_samples(sort_secondary_rays ? batch_size : 0);
+
+  const AABB scene_box = world.bounding_box();
+  const glm::dvec3 scene_min(scene_box.x.min, scene_box.y.min, scene_box.z.min);
+  const glm::dvec3 scene_size(scene_box.x.size(), scene_box.y.size(), scene_box.z.size());
+  glm::dvec3 cell_scale(0.0);
+  for (int axis = 0; axis < 3; ++axis)
+    if (std::isfinite(scene_size[axis]) && scene_size[axis] > 0.0) cell_scale[axis] = 511.0 / scene_size[axis];
+
+  // Reported at the end, to weigh the cost of binning against the traversal time it saves. The
+  // secondary rays of the first batch that has any are traced a second time unsorted, and the hits
+  // discarded, so the report can compare both orders on the same rays.
+  double reorder_seconds = 0.0;
+  double secondary_seconds = 0.0;
+  size_t secondary_rays = 0;
+  double baseline_sorted_seconds = 0.0;
+  double baseline_unsorted_seconds = 0.0;
+  size_t baseline_rays = 0;
+  size_t baseline_batch = std::numeric_limits<size_t>::max(); // first_sample of the batch traced both ways
+  std::vector<HitRecord> baseline_hits;
+
+  // Sample indices of the pass continue each pixel's sample sequence where earlier passes left it.
+  std::vector<int> first_indices(pixels.size());
+  for (size_t p = 0; p < pixels.size(); ++p)
+    first_indices[p] = film.count[pixels[p] - film.first_pixel];
+  auto start_pixel_sample = [&](Sampler& pixel_sampler, size_t sample, uint32_t dimension) {
+    size_t p = sample / pixel_samples;
+    pixel_sampler.start_pixel_sample(pixels[p], uint32_t(first_indices[p] + sample % pixel_samples), dimension);
+  };
+
+  // Intersection can draw random numbers too (ConstantMedium::hit()). Each chunk draws them from the
+  // stream of its first ray's sample, stage (2 * depth, + 1 for shadow rays) by stage, so they
+  // don't depend on which thread takes the chunk.
+  size_t first_sample = 0;
+  auto for_each_chunk = [&](int count, const std::vector<uint32_t>& queue_samples, uint32_t stage, auto&& trace) {
+    const int chunks = (count + chunk_size - 1) / chunk_size;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < chunks; ++c) {
+      size_t first = size_t(c) * chunk_size;
+      size_t n = std::min<size_t>(chunk_size, count - first);
+      IndependentSampler traversal_sampler(seed);
+      start_pixel_sample(traversal_sampler, first_sample + queue_samples[first], Sampler::traversal_dimensions + (stage << 16));
+      SamplerScope sampler_scope(traversal_sampler);
+      trace(first, n);
+    }
+  };
+  auto intersect = [&](const std::vector<Ray>& queue, std::vector<HitRecord>& queue_hits, int count, bool coherent,
+                       const std::vector<uint32_t>& queue_samples, uint32_t stage) {
+    for_each_chunk(count, queue_samples, stage, [&](size_t first, size_t n) {
+      if (!coherent) {
+        world.hit_batch(std::span<const Ray>(queue.data() + first, n), Interval(0.001, infinity), std::span<HitRecord>(queue_hits.data() + first, n));
+        return;
+      }
+      for (size_t p = first; p < first + n; p += RayPacket::max_size) {
+        size_t lanes = std::min<size_t>(RayPacket::max_size, first + n - p);
+        RayPacket packet(std::span<const Ray>(queue.data() + p, lanes));
+        world.hit_packet(packet, Interval(0.001, infinity), std::span<HitRecord>(queue_hits.data() + p, lanes));
+      }
+    });
+  };
+  auto occlude = [&](const std::vector<Ray>& queue, std::vector<uint8_t>& blocked, int count,
+                     const std::vector<uint32_t>& queue_samples, uint32_t stage) {
+    for_each_chunk(count, queue_samples, stage, [&](size_t first, size_t n) {
+      world.occluded_batch(std::span<const Ray>(queue.data() + first, n), Interval(0.001, infinity), std::span<uint8_t>(blocked.data() + first, n));
+    });
+  };
+
+  for (; first_sample < total_samples; first_sample += batch_size) {
+    const int count = int(std::min(batch_size, total_samples - first_sample));
+
+    // Generate. Consecutive samples belong to the same pixel, so primary rays start out coherent.
+#pragma omp parallel
+    {
+      auto pixel_sampler = make_sampler(sampler, seed);
+      SamplerScope sampler_scope(*pixel_sampler);
+#pragma omp for schedule(static)
+      for (int k = 0; k < count; ++k) {
+        size_t sample = first_sample + k;
+        int pixel = int(pixels[sample / pixel_samples]);
+        start_pixel_sample(*pixel_sampler, sample, 0);
+        rays[k] = get_ray(pixel % image_width, pixel / image_width);
+        throughputs[k] = glm::vec3(1.0f);
+        bsdf_pdfs[k] = 0.0;
+        specular_bounces[k] = 1;
+        samples[k] = uint32_t(k);
+        dimensions[k] = Sampler::camera_dimensions;
+        radiance[k] = glm::vec3(0.0f);
+      }
+    }
+
+    int active = count;
+    for (int depth = 0; depth < max_depth && active > 0; ++depth) {
+      // Intersect
+      if (depth == 0) {
+        intersect(rays, hits, active, true, samples, 0);
+        if (film.has_features()) {
+#pragma omp parallel for schedule(static)
+          for (int k = 0; k < active; ++k)
+            features[k] = first_hit_features(rays[k], hits[k]);
+        }
+      }
+      else if (!sort_secondary_rays) {
+        auto intersect_start = std::chrono::steady_clock::now();
+        intersect(rays, hits, active, false, samples, 2 * depth);
+        secondary_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - intersect_start).count();
+        secondary_rays += active;
+      }
+      else {
+        auto reorder_start = std::chrono::steady_clock::now();
+#pragma omp parallel for schedule(static)
+        for (int k = 0; k < active; ++k) {
+          const glm::dvec3& d = rays[k].direction();
+          uint32_t octant = (d.x < 0.0 ? 1u : 0u) | (d.y < 0.0 ? 2u : 0u) | (d.z < 0.0 ? 4u : 0u);
+          glm::dvec3 cell = glm::clamp((rays[k].origin() - scene_min) * cell_scale, 0.0, 511.0);
+          uint32_t morton = morton_code_3d(uint32_t(cell.x), uint32_t(cell.y), uint32_t(cell.z));
+          sort_keys[k] = (uint64_t((octant << 27) | morton) << 32) | uint32_t(k);
+        }
+        radix_sort_high_bits(sort_keys, sort_scratch, active);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < active; ++i) {
+          sorted_rays[i] = rays[uint32_t(sort_keys[i])];
+          sorted_samples[i] = samples[uint32_t(sort_keys[i])];
+        }
+        auto intersect_start = std::chrono::steady_clock::now();
+
+        intersect(sorted_rays, sorted_hits, active, false, sorted_samples, 2 * depth);
+
+        auto intersect_end = std::chrono::steady_clock::now();
+        if (baseline_batch == std::numeric_limits<size_t>::max())
+          baseline_batch = first_sample;
+        if (baseline_batch == first_sample) {
+          baseline_hits.resize(batch_size);
+          intersect(rays, baseline_hits, active, false, samples, 2 * depth);
+          baseline_unsorted_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - intersect_end).count();
+          baseline_sorted_seconds += std::chrono::duration<double>(intersect_end - intersect_start).count();
+          baseline_rays += active;
+        }
+        auto scatter_start = std::chrono::steady_clock::now();
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < active; ++i)
+          hits[uint32_t(sort_keys[i])] = sorted_hits[i];
+
+        secondary_seconds += std::chrono::duration<double>(intersect_end - intersect_start).count();
+        reorder_seconds += std::chrono::duration<double>(intersect_start - reorder_start).count()
+                         + std::chrono::duration<double>(std::chrono::steady_clock::now() - scatter_start).count();
+        secondary_rays += active;
+      }
+
+      // Sort
+      size_t known_materials = materials.size();
+      for (int k = 0; k < active; ++k) {
+        shadow_lights[k] = nullptr;
+        shadow_environment[k] = 0;
+        if (!hits[k].prim) {
+          radiance[samples[k]] += throughputs[k] * escaped_radiance(rays[k], bsdf_pdfs[k], specular_bounces[k] != 0);
+          alive[k] = 0;
+          continue;
+        }
+        auto [it, inserted] = material_ids.try_emplace(hits[k].material, uint32_t(materials.size()));
+        if (inserted) materials.push_back(hits[k].material);
+        hit_ids[k] = it->second;
+      }
+
+      if (materials.size() != known_materials) {
+        std::vector<uint32_t> by_rank(materials.size());
+        std::iota(by_rank.begin(), by_rank.end(), 0u);
+        std::sort(by_rank.begin(), by_rank.end(), [&materials](uint32_t a, uint32_t b) {
+          size_t type_a = typeid(*materials[a]).hash_code();
+          size_t type_b = typeid(*materials[b]).hash_code();
+          return type_a != type_b ? type_a < type_b : materials[a] < materials[b];
+        });
+        material_ranks.resize(materials.size());
+        for (uint32_t rank = 0; rank < by_rank.size(); ++rank)
+          material_ranks[by_rank[rank]] = rank;
+      }
 
-  std::shared_ptr<HittablePDF> light_ptr = std::make_shared<HittablePDF>(lights, hit_record.p);
-  MixturePDF p(light_ptr, scatter_record.pdf_ptr);
+      bucket_starts.assign(materials.size() + 1, 0);
+      for (int k = 0; k < active; ++k)
+        if (hits[k].prim) ++bucket_starts[material_ranks[hit_ids[k]] + 1];
+      std::partial_sum(bucket_starts.begin(), bucket_starts.end(), bucket_starts.begin());
+      const int shaded = int(bucket_starts.back());
+      for (int k = 0; k < active; ++k)
+        if (hits[k].prim) order[bucket_starts[material_ranks[hit_ids[k]]]++] = uint32_t(k);
 
-  Ray scattered_ray = Ray(hit_record.p, p.generate(), ray.time());
-  double pdf_value = p.value(scattered_ray.direction());
-  if (pdf_value < 1e-6) return emitted_color; // Avoids singularities
+      // Shade. Static scheduling hands every thread one contiguous run of the sorted hits.
+#pragma omp parallel
+      {
+        auto pixel_sampler = make_sampler(sampler, seed);
+        SamplerScope sampler_scope(*pixel_sampler);
+#pragma omp for schedule(static)
+        for (int o = 0; o < shaded; ++o) {
+          uint32_t k = order[o];
+          PathState path;
+          path.ray = rays[k];
+          path.throughput = throughputs[k];
+          path.previous_p = previous_ps[k];
+          path.bsdf_pdf = bsdf_pdfs[k];
+          path.specular_bounce = specular_bounces[k] != 0;
+          start_pixel_sample(*pixel_sampler, first_sample + samples[k], dimensions[k]);
 
-  double scattering_pdf = hit_record.material->scattering_pdf(ray, hit_record, scattered_ray);
-  
-  glm::vec3 sample_color = ray_color(scattered_ray, depth - 1, world, lights);
-  glm::vec3 scattered_color = (scatter_record.attenuation * (float)scattering_pdf * sample_color) / (float)pdf_value;
+          LightSample light_sample;
+          alive[k] = shade(path, hits[k], lights, depth, radiance[samples[k]], light_sample);
+
+          rays[k] = path.ray;
+          throughputs[k] = path.throughput;
+          previous_ps[k] = path.previous_p;
+          bsdf_pdfs[k] = path.bsdf_pdf;
+          specular_bounces[k] = path.specular_bounce;
+          dimensions[k] = pixel_sampler->dimension();
+          shadow_rays[k] = light_sample.ray;
+          shadow_lights[k] = light_sample.light;
+          shadow_environment[k] = light_sample.environment;
+          shadow_weights[k] = light_sample.weight;
+        }
+      }
 
-  return emitted_color + scattered_color; // Combine emitted color and scattered color
+      // Shadow. The queue is compacted first, its entries never move forward past their slot.
+      int shadow_count = 0;
+      int environment_count = 0;
+      for (int k = 0; k < active; ++k) {
+        if (shadow_environment[k]) {
+          environment_rays[environment_count] = shadow_rays[k];
+          environment_weights[environment_count] = shadow_weights[k];
+          environment_samples[environment_count] = samples[k];
+          ++environment_count;
+          continue;
+        }
+        if (!shadow_lights[k]) continue;
+        shadow_rays[shadow_count] = shadow_rays[k];
+        shadow_lights[shadow_count] = shadow_lights[k];
+        shadow_weights[shadow_count] = shadow_weights[k];
+        shadow_samples[shadow_count] = samples[k];
+        ++shadow_count;
+      }
+      intersect(shadow_rays, shadow_hits, shadow_count, false, shadow_samples, 2 * depth + 1);
+      occlude(environment_rays, environment_blocked, environment_count, environment_samples, 2 * depth + 1);
+
+#pragma omp parallel for schedule(static)
+      for (int q = 0; q < shadow_count; ++q) {
+        const HitRecord& light_record = shadow_hits[q];
+        if (light_record.prim != shadow_lights[q]) continue;
+        radiance[shadow_samples[q]] += shadow_weights[q] * light_record.material->emitted(shadow_rays[q], light_record, light_record.u, light_record.v, light_record.p);
+      }
+      for (int q = 0; q < environment_count; ++q)
+        if (!environment_blocked[q]) radiance[environment_samples[q]] += environment_weights[q];
+
+      // Compact the live paths to the front.
+      int next = 0;
+      for (int k = 0; k < active; ++k) {
+        if (!alive[k]) continue;
+        if (next != k) {
+          rays[next] = rays[k];
+          throughputs[next] = throughputs[k];
+          previous_ps[next] = previous_ps[k];
+          bsdf_pdfs[next] = bsdf_pdfs[k];
+          specular_bounces[next] = specular_bounces[k];
+          samples[next] = samples[k];
+          dimensions[next] = dimensions[k];
+        }
+        ++next;
+      }
+      active = next;
+    }
+
+    for (int k = 0; k < count; ++k)
+      film.add(pixels[(first_sample + k) / pixel_samples] - film.first_pixel, radiance[k], film.has_features() ? features[k] : Features());
+
+    std::clog << "\rSamples remaining: " << (total_samples - first_sample - count) << ' ' << std::flush;
+  }
+
+  std::clog << "\nSecondary rays: " << secondary_rays << " traced in " << secondary_seconds << " seconds ("
+            << 1e9 * secondary_seconds / std::max<size_t>(secondary_rays, 1) << " ns/ray)";
+  if (sort_secondary_rays)
+    std::clog << ", binning took " << reorder_seconds << " seconds";
+  std::clog << ".\n";
+  if (baseline_rays > 0) {
+    const double sorted_ns = 1e9 * baseline_sorted_seconds / baseline_rays;
+    const double unsorted_ns = 1e9 * baseline_unsorted_seconds / baseline_rays;
+    std::clog << "Binning on one batch's " << baseline_rays << " secondary rays: " << sorted_ns << " ns/ray sorted, "
+              << unsorted_ns << " ns/ray unsorted (" << 100.0 * (1.0 - sorted_ns / std::max(unsorted_ns, 1e-9)) << "% saved).\n";
+  }
 }
 
-glm::dvec3 Camera::defocus_disk_sample() const
+glm::dvec3 Camera::defocus_disk_sample(double u1, double u2) const
 {
-  // Returns a random point in the camera defocus disk.
-  glm::dvec3 p = random_in_unit_disk();
+  // Returns the point of the camera defocus disk for the uniform variates u1, u2.
+  glm::dvec2 p = sample_disk(u1, u2);
   return center + (p.x * defocus_disk_u) + (p.y * defocus_disk_v);
 }
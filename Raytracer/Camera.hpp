@@ -1,9 +1,22 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
 #include <glm/glm.hpp>
 
 #include "Hittable.hpp"
+#include "LightBVH.hpp"
 #include "Ray.hpp"
+#include "Denoiser.hpp"
+#include "EnvironmentMap.hpp"
+#include "Image.hpp"
+#include "Sampler.hpp"
+#include "TileScheduler.hpp"
 
 class Camera {
 public:
@@ -12,7 +25,62 @@ public:
   int     image_width       = 100;  // Rendered image width in pixels
   int     samples_per_pixel = 100;  // Number of samples per pixel
   int     max_depth         = 10;   // Maximum number of ray bounces into the scene
+  int     russian_roulette_depth = 3; // Bounce after which low-throughput paths are randomly terminated (>= max_depth disables it)
   glm::vec3 background;             // Scene Background color
+  std::shared_ptr<const EnvironmentMap> environment; // If set, replaces background: seen by rays leaving the scene and sampled as a light
+  SamplerType sampler = SamplerType::sobol; // Source of the random numbers of every pixel sample
+  uint32_t seed = 0;                // Renders with the same seed are identical, whatever the thread count; different seeds can be averaged
+
+  int     tile_size         = 32;     // Side in pixels of the tiles threads take work in, rounded up to whole packets
+  TileOrder tile_order      = TileOrder::hilbert; // Order tiles are rendered in; idle threads steal along it
+
+  bool    wavefront         = false;  // Trace paths in batches, one stage at a time, instead of one path at a time
+  int     wavefront_size    = 1 << 16; // Paths in flight per batch with the wavefront backend
+  bool    sort_secondary_rays = true; // Wavefront only: bin secondary rays by direction and origin before tracing them
+
+  // Adaptive sampling keeps samples_per_pixel as the average budget, but stops sampling pixels
+  // once their noise is below adaptive_threshold and spends what they leave on the noisy ones.
+  bool    adaptive_sampling    = false;
+  int     adaptive_min_samples = 64;    // Samples of every pixel before its noise is judged, also the size of each pass
+  int     adaptive_max_samples = 0;     // Most samples one pixel can take, 0 for 4 * samples_per_pixel
+  double  adaptive_threshold   = 0.01;  // Standard error a pixel must get under, after gamma correction ([0, 1] display scale)
+  std::string sample_count_map;         // If set, the number of samples taken by each pixel is written to this file as a PPM
+
+  // Progressive rendering takes samples_per_pixel in passes over the whole image and checkpoints
+  // the film between them, so an interrupted render can resume where it stopped. SIGUSR1 (Ctrl+Break
+  // on Windows) writes the image so far to snapshot_file; SIGINT or SIGTERM stop after the current
+  // pass with a checkpoint and output the image so far. Ignored with adaptive_sampling.
+  bool    progressive             = false;
+  int     progressive_pass_samples = 16;    // Samples per pixel of each pass, also the longest wait for a snapshot or a stop
+  std::string checkpoint_file;              // If set, the render resumes from this file when it exists and checkpoints to it
+  double  checkpoint_interval     = 300.0;  // Seconds between checkpoints
+  std::string snapshot_file       = "snapshot.ppm"; // Where snapshots of the image so far are written
+
+  // With a time budget the render measures its throughput as it goes and stops once the next pass
+  // would run past the deadline, samples_per_pixel becoming an upper bound (an average one with
+  // adaptive sampling). Without adaptive sampling every pixel gets the same number of samples,
+  // rendered progressively; the first adaptive pass is taken whatever the budget.
+  double  time_budget             = 0.0;    // Wall clock seconds the render may take from the call to render(), 0 for no limit
+
+  // Denoising. The first hit of every camera ray also records its albedo, shading normal and
+  // distance into auxiliary buffers (AOVs), which guide an edge aware filter over the finished
+  // image, see Denoiser.hpp.
+  bool    denoise                 = false;
+  int     denoise_iterations      = 5;      // Filter passes, each doubling the footprint (5 spans 125 pixels)
+  std::string aov_prefix;                   // If set, the albedo, normal, depth and variance buffers are written to <prefix>_albedo.pfm and so on
+
+  // Output. Without output_file the image goes to stdout as plain text P3.
+  std::string output_file;                  // If set, the image is written to this file in the format of its extension: .ppm (binary P6), .pfm (linear float, unclamped) or .png
+  Tonemap tonemap                 = Tonemap::clamp; // How radiance above 1 is brought into the 8 bit formats
+  double  exposure                = 0.0;    // Stops of exposure applied before tonemapping the 8 bit formats
+
+  // Streaming renders the image in bands of rows and appends each band to the output as soon as it
+  // is done, so memory stays bounded by one band however large the image, and the rows written so
+  // far can be read while the render goes on. PFM bands go bottom up, the way the format stores
+  // rows. The whole image is never held, so denoise, aov_prefix, adaptive_sampling, progressive,
+  // time_budget and sample_count_map are ignored, and framebuffer() stays empty.
+  bool    streaming               = false;
+  int     stream_band_rows        = 0;      // Rows per band, rounded up to whole tiles; 0 for one row of tiles
 
   double  vertical_fov      = 90.0; // Vertical field of view in degrees
 
@@ -23,13 +91,63 @@ public:
   glm::dvec3 look_at = glm::dvec3(0.0);   // Point the camera is looking at
   glm::dvec3 view_up = glm::dvec3(0.0);   // Up vector for the camera
 
-  void render(const Hittable& world, const Hittable& lights);
+  // Renders the scene. Light sources are found automatically from the emissive materials in world.
+  void render(const Hittable& world);
+
+  // Linear radiance of the last render (denoised if enabled), unclamped, rows top to bottom.
+  const std::vector<glm::vec3>& framebuffer() const { return linear_image; }
 
 private:
+  // State a path carries from one bounce to the next.
+  struct PathState {
+    Ray ray;                                // Ray to trace for the next bounce
+    glm::vec3 throughput = glm::vec3(1.0f); // Product of attenuation * scattering_pdf / pdf of every bounce so far
+    glm::dvec3 previous_p = glm::dvec3(0.0); // Origin of the previous BSDF sample
+    double bsdf_pdf = 0.0;                  // Density of the previous BSDF sample
+    bool specular_bounce = true;            // The camera acts as a specular vertex
+  };
+
+  // Next event estimation sample waiting for its shadow ray. Adds weight * emission to the path's
+  // radiance if the closest hit of ray is light.
+  struct LightSample {
+    Ray ray;
+    const Hittable* light = nullptr;
+    glm::vec3 weight = glm::vec3(0.0f);
+    bool environment = false; // Sample of the environment map, weight includes its radiance: counts if ray hits nothing
+  };
+
+  // What the denoiser needs to know of the first surface a camera ray hits.
+  struct Features {
+    glm::vec3 albedo = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f);
+    float depth = 0.0f;
+  };
+
+  // Running sample statistics of every pixel, the image is sum / count.
+  struct Film {
+    std::vector<glm::vec3> sum;       // Sum of the sample radiances
+    std::vector<double> luminance_sq; // Sum of the squared sample luminances
+    std::vector<int> count;           // Number of samples taken
+    std::vector<glm::vec3> albedo;    // Sums of the first hit features, empty unless denoising or writing AOVs
+    std::vector<glm::vec3> normal;
+    std::vector<float> depth;
+    size_t first_pixel = 0;           // Image index of the film's pixel 0: a band of a streamed render covers only its rows
+
+    void allocate(size_t pixels, bool features);
+    bool has_features() const { return !albedo.empty(); }
+    void add(size_t pixel, const glm::vec3& radiance, const Features& features);
+    void merge(size_t pixel, const Film& slice, size_t slice_pixel); // Adds the samples of slice_pixel of slice
+    glm::vec3 mean(size_t pixel) const;
+    double variance(size_t pixel) const; // Variance of the mean luminance, 0 under two samples
+    double error(size_t pixel) const;
+  };
+
+  static constexpr int packet_width = 8; // Camera rays are traced in packets of packet_width x packet_width pixels
+  static constexpr int min_work_units = 256; // Tiles are split by samples until a pass has this many units, enough for 64 threads to balance
+
+  std::vector<glm::vec3> linear_image; // Result of the last render
+
   int         image_height;   // Rendered image height
-  double       pixel_samples_scale; // Color scale factor for a sum of pixel samples  
-  int    sqrt_spp;             // Square root of number of samples per pixel
-  double recip_sqrt_spp;       // 1 / sqrt_spp
   glm::dvec3  center;         // Camera center
   glm::dvec3  pixel00_loc;    // Location of pixel 0, 0
   glm::dvec3  pixel_delta_u;  // Offset to pixel to the right
@@ -37,13 +155,30 @@ private:
   glm::dvec3  u, v, w;        // Camera basis vectors
   glm::dvec3 defocus_disk_u;  // Defocus disk horizontal radius
   glm::dvec3 defocus_disk_v;  // Defocus disk vertical radius
+  double environment_pick = 0.0; // Probability that light sampling picks the environment map over the scene's emitters
 
   void initialize();
 
-  Ray get_ray(int i, int j, int s_i, int s_j) const;
+  // Sampling passes: every pixel listed in pixels takes its next samples samples.
+  void render_pass(const Hittable& world, const LightBVH& lights, Film& film, std::span<const uint32_t> pixels, int samples) const;
+  void render_tiles(const Hittable& world, const LightBVH& lights, Film& film, std::span<const uint32_t> pixels, int samples) const;
+  void render_adaptive(const Hittable& world, const LightBVH& lights, Film& film, std::chrono::steady_clock::time_point deadline) const;
+  void render_progressive(const Hittable& world, const LightBVH& lights, Film& film, std::chrono::steady_clock::time_point deadline) const;
+  void render_streaming(const Hittable& world, const LightBVH& lights) const;
+  void write_sample_count_map(const Film& film) const;
+
+  ImageBuffers resolve(const Film& film) const; // Per pixel means of the film
+  void write_aovs(const ImageBuffers& image) const;
+  bool save_checkpoint(const Film& film) const;
+  bool load_checkpoint(Film& film) const; // False if there is no checkpoint for this camera
+
+  Ray get_ray(int i, int j) const;
   glm::dvec3 sample_square() const;
-  glm::dvec3 sample_square_stratified(int i, int j) const;
-  glm::vec3 ray_color(const Ray& ray, int depth, const Hittable& world, const Hittable& lights) const;
-  glm::dvec3 defocus_disk_sample() const;
+  Features first_hit_features(const Ray& ray, const HitRecord& rec) const;
+  glm::vec3 ray_color(const Ray& ray, const Hittable& world, const LightBVH& lights, const HitRecord* primary_hit = nullptr) const;
+  glm::vec3 escaped_radiance(const Ray& ray, double bsdf_pdf, bool specular_bounce) const;
+  bool shade(PathState& path, const HitRecord& rec, const LightBVH& lights, int depth, glm::vec3& radiance, LightSample& light_sample) const;
+  void render_wavefront(const Hittable& world, const LightBVH& lights, Film& film, std::span<const uint32_t> pixels, int pixel_samples) const;
+  glm::dvec3 defocus_disk_sample(double u1, double u2) const;
 
 };
\ No newline at end of file
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <glm/glm.hpp>
+
+// Compact encodings used to store large meshes. Everything here is branch-light so it can be
+// decoded on the fly inside intersection kernels.
+
+// 16-bit unsigned normalized quantization ---------------------------------------
+
+inline uint16_t quantize_unorm16(double value, double min, double inv_extent) {
+  // Maps value in [min, min + extent] onto [0, 65535], rounding to nearest.
+  double n = (value - min) * inv_extent;
+  n = n < 0.0 ? 0.0 : (n > 1.0 ? 1.0 : n);
+  return static_cast<uint16_t>(n * 65535.0 + 0.5);
+}
+
+inline double dequantize_unorm16(uint16_t q, double min, double step) {
+  // step = extent / 65535
+  return min + q * step;
+}
+
+// Octahedral normal encoding (Cigolle et al. 2014, "A Survey of Efficient Representations
+// for Independent Unit Vectors"). Two 16-bit snorm values packed into 32 bits.
+
+inline double sign_not_zero(double v) {
+  return v >= 0.0 ? 1.0 : -1.0;
+}
+
+inline uint32_t encode_octahedral(const glm::dvec3& n) {
+  double l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  double x = n.x / l1;
+  double y = n.y / l1;
+  if (n.z < 0.0) {
+    double ox = (1.0 - std::abs(y)) * sign_not_zero(x);
+    double oy = (1.0 - std::abs(x)) * sign_not_zero(y);
+    x = ox;
+    y = oy;
+  }
+  auto to_snorm16 = [](double v) -> uint32_t {
+    v = v < -1.0 ? -1.0 : (v > 1.0 ? 1.0 : v);
+    return static_cast<uint16_t>(static_cast<int16_t>(std::round(v * 32767.0)));
+  };
+  return to_snorm16(x) | (to_snorm16(y) << 16);
+}
+
+inline glm::dvec3 decode_octahedral(uint32_t packed) {
+  double x = static_cast<int16_t>(packed & 0xffff) / 32767.0;
+  double y = static_cast<int16_t>(packed >> 16) / 32767.0;
+  double z = 1.0 - std::abs(x) - std::abs(y);
+  if (z < 0.0) {
+    double ox = (1.0 - std::abs(y)) * sign_not_zero(x);
+    double oy = (1.0 - std::abs(x)) * sign_not_zero(y);
+    x = ox;
+    y = oy;
+  }
+  return glm::normalize(glm::dvec3(x, y, z));
+}
+
+// IEEE 754 half precision ----------------------------------------------------------
+// Software conversion so we don't depend on F16C being available.
+
+inline uint16_t float_to_half(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+
+  uint32_t sign = (bits >> 16) & 0x8000;
+  int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (((bits >> 23) & 0xff) == 0xff) // Inf / NaN
+    return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+  if (exponent >= 31) // Overflow, clamp to infinity
+    return static_cast<uint16_t>(sign | 0x7c00);
+  if (exponent <= 0) { // Subnormal or zero
+    if (exponent < -10) return static_cast<uint16_t>(sign);
+    mantissa |= 0x800000;
+    uint32_t shift = static_cast<uint32_t>(14 - exponent);
+    uint32_t half_mantissa = mantissa >> shift;
+    uint32_t round_bit = 1u << (shift - 1);
+    if ((mantissa & round_bit) && (mantissa & (3 * round_bit - 1))) ++half_mantissa;
+    return static_cast<uint16_t>(sign | half_mantissa);
+  }
+
+  uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+  // Round to nearest even; a carry into the exponent is the correct result.
+  if ((mantissa & 0x1000) && (mantissa & 0x2fff)) ++half;
+  return static_cast<uint16_t>(half);
+}
+
+inline float half_to_float(uint16_t half) {
+  uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1f;
+  uint32_t mantissa = half & 0x3ff;
+  uint32_t bits;
+
+  if (exponent == 0) {
+    if (mantissa == 0) {
+      bits = sign;
+    } else { // Renormalize the subnormal
+      exponent = 127 - 15 + 1;
+      while ((mantissa & 0x400) == 0) {
+        mantissa <<= 1;
+        --exponent;
+      }
+      mantissa &= 0x3ff;
+      bits = sign | (exponent << 23) | (mantissa << 13);
+    }
+  } else if (exponent == 0x1f) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  }
+
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+inline uint32_t encode_half2(double u, double v) {
+  return float_to_half(static_cast<float>(u)) | (static_cast<uint32_t>(float_to_half(static_cast<float>(v))) << 16);
+}
+
+inline glm::dvec2 decode_half2(uint32_t packed) {
+  return glm::dvec2(half_to_float(static_cast<uint16_t>(packed & 0xffff)), half_to_float(static_cast<uint16_t>(packed >> 16)));
+}
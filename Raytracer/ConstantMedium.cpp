@@ -26,11 +26,17 @@ bool ConstantMedium::hit(const Ray& r, Interval ray_t, HitRecord& rec) const {
     return false;
 
   rec.t = rec1.t + hit_distance / ray_length;
+  rec.prim = this;
+  rec.prim_id = 0;
+  rec.shape_ptr = this;
+
+  return true;
+}
+
+void ConstantMedium::surface_interaction(const Ray& r, HitRecord& rec) const {
   rec.p = r.at(rec.t);
 
   rec.normal = glm::dvec3(1, 0, 0);  // arbitrary
   rec.front_face = true;     // also arbitrary
-  rec.material = phase_function;
-
-  return true;
+  rec.material = phase_function.get();
 }
\ No newline at end of file
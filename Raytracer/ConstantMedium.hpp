@@ -21,6 +21,8 @@ public:
 
   bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override;
 
+  void surface_interaction(const Ray& r, HitRecord& rec) const override;
+
   inline AABB bounding_box() const override { return boundary->bounding_box(); }
 
 private:
@@ -0,0 +1,107 @@
+#include "Denoiser.hpp"
+#include "Utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace {
+  constexpr float kernel[3] = { 3.f / 8.f, 1.f / 4.f, 1.f / 16.f }; // B3 spline weights by tap offset
+
+  constexpr float sigma_luminance = 4.f; // Luminance difference tolerated, in standard deviations of the center's noise
+  constexpr float sigma_normal = 64.f;   // Exponent of the cosine between the normals
+  constexpr float sigma_depth = 0.005f;  // Relative depth difference tolerated per pixel of distance
+  constexpr float sigma_albedo = 0.1f;   // Albedo difference tolerated
+  constexpr float min_albedo = 0.01f;    // Darker albedos are clamped before dividing by them
+
+  // Variance blurred with a 3x3 Gaussian: SVGF's guard against a single noisy variance estimate.
+  void blur_variance(const std::vector<float>& variance, std::vector<float>& blurred, int width, int height) {
+    static constexpr float weights[2] = { 0.5f, 0.25f };
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        float sum = 0.f, weight_sum = 0.f;
+        for (int dy = -1; dy <= 1; ++dy) {
+          for (int dx = -1; dx <= 1; ++dx) {
+            const int qx = x + dx, qy = y + dy;
+            if (qx < 0 || qx >= width || qy < 0 || qy >= height) continue;
+            const float weight = weights[std::abs(dx)] * weights[std::abs(dy)];
+            sum += weight * variance[size_t(qy) * width + qx];
+            weight_sum += weight;
+          }
+        }
+        blurred[size_t(y) * width + x] = sum / weight_sum;
+      }
+    }
+  }
+}
+
+std::vector<glm::vec3> denoise_image(const ImageBuffers& image, int iterations) {
+  const int width = image.width;
+  const int height = image.height;
+  const size_t pixel_count = size_t(width) * height;
+
+  // Filter the lighting alone: color over albedo, and its variance scaled to match.
+  std::vector<glm::vec3> albedo(pixel_count), normal(pixel_count);
+  std::vector<glm::vec3> irradiance(pixel_count), filtered(pixel_count);
+  std::vector<float> variance(pixel_count), filtered_variance(pixel_count), blurred_variance(pixel_count);
+  for (size_t p = 0; p < pixel_count; ++p) {
+    albedo[p] = glm::max(image.albedo[p], glm::vec3(min_albedo));
+    irradiance[p] = image.color[p] / albedo[p];
+    const float y = std::max(luminance(albedo[p]), min_albedo);
+    variance[p] = image.variance[p] / (y * y);
+    const float length = glm::length(image.normal[p]);
+    normal[p] = length > 0.f ? image.normal[p] / length : glm::vec3(0.f);
+  }
+
+  for (int iteration = 0; iteration < iterations; ++iteration) {
+    const int step = 1 << iteration;
+    blur_variance(variance, blurred_variance, width, height);
+
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        const size_t p = size_t(y) * width + x;
+        const float luminance_p = luminance(irradiance[p]);
+        const float luminance_scale = sigma_luminance * std::sqrt(blurred_variance[p]) + 1e-6f;
+        const float depth_p = image.depth[p];
+
+        glm::vec3 sum(0.f);
+        float weight_sum = 0.f, variance_sum = 0.f;
+        for (int dy = -2; dy <= 2; ++dy) {
+          for (int dx = -2; dx <= 2; ++dx) {
+            const int qx = x + dx * step, qy = y + dy * step;
+            if (qx < 0 || qx >= width || qy < 0 || qy >= height) continue;
+            const size_t q = size_t(qy) * width + qx;
+
+            float weight = kernel[std::abs(dx)] * kernel[std::abs(dy)];
+            if (q != p) {
+              // Pixels where the camera ray escaped have a zero normal and depth: they only
+              // blend with each other.
+              const bool p_escaped = normal[p] == glm::vec3(0.f), q_escaped = normal[q] == glm::vec3(0.f);
+              const float cosine = p_escaped && q_escaped ? 1.f : std::max(glm::dot(normal[p], normal[q]), 0.f);
+              const float distance = float(step * std::max(std::abs(dx), std::abs(dy)));
+              const float depth_difference = std::abs(depth_p - image.depth[q]) / (sigma_depth * distance * std::max(depth_p, 1e-6f));
+              const float albedo_difference = glm::length(image.albedo[p] - image.albedo[q]) / sigma_albedo;
+              const float luminance_difference = std::abs(luminance_p - luminance(irradiance[q])) / luminance_scale;
+              weight *= std::pow(cosine, sigma_normal)
+                * std::exp(-depth_difference - albedo_difference * albedo_difference - luminance_difference);
+            }
+
+            sum += weight * irradiance[q];
+            weight_sum += weight;
+            variance_sum += weight * weight * variance[q];
+          }
+        }
+        filtered[p] = sum / weight_sum;
+        filtered_variance[p] = variance_sum / (weight_sum * weight_sum);
+      }
+    }
+    irradiance.swap(filtered);
+    variance.swap(filtered_variance);
+  }
+
+  for (size_t p = 0; p < pixel_count; ++p)
+    irradiance[p] *= albedo[p];
+  return irradiance;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Per pixel buffers of a render, averaged over the pixel's samples. The feature buffers (albedo,
+// normal, depth) describe the first surface seen through the pixel and are nearly noise free.
+struct ImageBuffers {
+  int width = 0;
+  int height = 0;
+  std::vector<glm::vec3> color;  // Mean radiance
+  std::vector<float> variance;   // Variance of the mean luminance
+  std::vector<glm::vec3> albedo; // First hit albedo
+  std::vector<glm::vec3> normal; // First hit shading normal, averaged (not renormalized)
+  std::vector<float> depth;      // First hit distance from the camera, 0 where camera rays escaped
+};
+
+// Edge aware denoiser: the "Edge-Avoiding A-Trous Wavelet Transform for fast Global Illumination
+// Filtering" (Dammertz et al. 2010) with the variance guided color weight of SVGF (Schied et al.
+// 2017). Each iteration applies a 5x5 B3 spline kernel whose taps are spread 2^i pixels apart, so
+// iterations widen the footprint cheaply. Taps are weighted down when their normal, depth or albedo
+// differ from the center pixel's, and when their luminance differs by more than the center's noise
+// explains; the variance is filtered along and shrinks with every iteration.
+//
+// The color is divided by the albedo before filtering and multiplied back after, so textures stay
+// sharp while the lighting is smoothed. Needs the feature buffers; rows are filtered in parallel.
+std::vector<glm::vec3> denoise_image(const ImageBuffers& image, int iterations);
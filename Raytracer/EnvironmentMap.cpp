@@ -0,0 +1,105 @@
+#include "EnvironmentMap.hpp"
+#include "ImageLoader.hpp"
+#include "Utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+  // Piece of the piecewise constant distribution with CDF cdf[0, n] that u falls in, and where u is
+  // inside it, in [0, 1).
+  template <typename T>
+  int sample_cdf(const T* cdf, int n, double u, double& offset) {
+    const int i = std::clamp(int(std::upper_bound(cdf, cdf + n + 1, T(u)) - cdf) - 1, 0, n - 1);
+    const double width = double(cdf[i + 1]) - double(cdf[i]);
+    offset = width > 0.0 ? std::clamp((u - double(cdf[i])) / width, 0.0, 1.0) : 0.0;
+    return i;
+  }
+}
+
+EnvironmentMap::EnvironmentMap(const char* image_filename, float scale, double rotation)
+  : scale(scale), rotation(degrees_to_radians(rotation)) {
+  // A missing image leaves a single magenta texel, a noticeable error color.
+  Image image(image_filename);
+  width = std::max(image.width(), 1);
+  height = std::max(image.height(), 1);
+  texels.resize(size_t(width) * height);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const float* pixel = image.linear_pixel_data(x, y);
+      texels[size_t(y) * width + x] = glm::vec3(pixel[0], pixel[1], pixel[2]);
+    }
+  }
+  build_distribution();
+}
+
+EnvironmentMap::EnvironmentMap(int width, int height, std::vector<glm::vec3> texels, float scale, double rotation)
+  : width(width), height(height), texels(std::move(texels)), scale(scale), rotation(degrees_to_radians(rotation)) {
+  build_distribution();
+}
+
+void EnvironmentMap::build_distribution() {
+  weights.resize(texels.size());
+  row_cdf.assign(size_t(height) + 1, 0.0);
+  column_cdfs.assign(size_t(height) * (width + 1), 0.0f);
+
+  // An all black map still needs a valid distribution: fall back to weighting by solid angle alone.
+  bool black = std::none_of(texels.begin(), texels.end(), [](const glm::vec3& texel) { return luminance(texel) > 0.0f; });
+  for (int y = 0; y < height; ++y) {
+    const double sin_theta = std::sin(pi * (y + 0.5) / height);
+    float* cdf = column_cdfs.data() + size_t(y) * (width + 1);
+    double row_sum = 0.0;
+    for (int x = 0; x < width; ++x) {
+      const size_t index = size_t(y) * width + x;
+      weights[index] = float((black ? 1.0 : std::max(double(luminance(texels[index])), 0.0)) * sin_theta);
+      row_sum += weights[index];
+      cdf[x + 1] = float(row_sum);
+    }
+    for (int x = 1; x <= width; ++x)
+      cdf[x] = row_sum > 0.0 ? float(cdf[x] / row_sum) : float(x) / width;
+    row_cdf[y + 1] = row_cdf[y] + row_sum;
+  }
+
+  total_weight = row_cdf[height];
+  for (int y = 1; y <= height; ++y)
+    row_cdf[y] /= total_weight;
+}
+
+int EnvironmentMap::texel_index(const glm::dvec3& direction, double& sin_theta) const {
+  const glm::dvec3 d = glm::normalize(direction);
+  const double theta = std::acos(std::clamp(d.y, -1.0, 1.0));
+  double phi = std::atan2(d.z, d.x) - rotation;
+  phi -= 2.0 * pi * std::floor(phi / (2.0 * pi));
+  sin_theta = std::sin(theta);
+
+  const int x = std::min(int(phi / (2.0 * pi) * width), width - 1);
+  const int y = std::min(int(theta / pi * height), height - 1);
+  return y * width + x;
+}
+
+glm::vec3 EnvironmentMap::radiance(const glm::dvec3& direction) const {
+  double sin_theta;
+  return scale * texels[texel_index(direction, sin_theta)];
+}
+
+glm::dvec3 EnvironmentMap::sample(double u1, double u2, double& pdf) const {
+  double row_offset, column_offset;
+  const int y = sample_cdf(row_cdf.data(), height, u1, row_offset);
+  const int x = sample_cdf(column_cdfs.data() + size_t(y) * (width + 1), width, u2, column_offset);
+
+  // Density over the unit square of image coordinates, then over solid angle: the image's
+  // 2 pi x pi angles stretch it by 2 pi^2 sin(theta).
+  const double theta = pi * (y + row_offset) / height;
+  const double phi = 2.0 * pi * (x + column_offset) / width + rotation;
+  const double sin_theta = std::sin(theta);
+  const double image_pdf = weights[size_t(y) * width + x] * double(width) * height / total_weight;
+  pdf = sin_theta > 0.0 ? image_pdf / (2.0 * pi * pi * sin_theta) : 0.0;
+  return glm::dvec3(sin_theta * std::cos(phi), std::cos(theta), sin_theta * std::sin(phi));
+}
+
+double EnvironmentMap::pdf(const glm::dvec3& direction) const {
+  double sin_theta;
+  const int index = texel_index(direction, sin_theta);
+  if (sin_theta <= 0.0) return 0.0;
+  return weights[index] * double(width) * height / total_weight / (2.0 * pi * pi * sin_theta);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Distant light from every direction, stored as an equirectangular (latitude-longitude) image:
+// row 0 looks straight up (+y), columns go around the y axis. Rays that leave the scene see it,
+// and next event estimation samples it.
+//
+// Sampling follows a 2D piecewise constant distribution over the texels, as in PBRT: a row is
+// picked from the marginal distribution of the row sums, then a column from that row's conditional
+// distribution. Texels are weighted by their luminance times sin(theta), the solid angle they cover,
+// so a small bright sun gets most of the samples instead of the sky around it.
+class EnvironmentMap {
+public:
+  // Loads image_filename through Image, so Radiance .hdr files keep their full range. scale
+  // multiplies the radiance, rotation turns the map around the y axis, in degrees.
+  explicit EnvironmentMap(const char* image_filename, float scale = 1.0f, double rotation = 0.0);
+
+  // A map from width x height linear texels, rows top to bottom.
+  EnvironmentMap(int width, int height, std::vector<glm::vec3> texels, float scale = 1.0f, double rotation = 0.0);
+
+  // Radiance arriving along -direction, from the texel direction points at.
+  glm::vec3 radiance(const glm::dvec3& direction) const;
+
+  // Direction for the uniform variates u1, u2, and its solid angle density in pdf (0 for a
+  // direction that can't be used).
+  glm::dvec3 sample(double u1, double u2, double& pdf) const;
+
+  // Solid angle density of sample() generating direction.
+  double pdf(const glm::dvec3& direction) const;
+
+private:
+  int width = 0;
+  int height = 0;
+  std::vector<glm::vec3> texels;
+  float scale = 1.0f;
+  double rotation = 0.0;          ///< Radians around the y axis
+
+  std::vector<float> weights;     ///< Sampling weight of every texel, luminance * sin(theta)
+  std::vector<double> row_cdf;    ///< Marginal CDF over the rows, height + 1 entries
+  std::vector<float> column_cdfs; ///< Conditional CDF over the columns of each row, width + 1 entries per row
+  double total_weight = 0.0;
+
+  void build_distribution();
+  int texel_index(const glm::dvec3& direction, double& sin_theta) const;
+};
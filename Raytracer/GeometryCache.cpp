@@ -0,0 +1,191 @@
+#include "GeometryCache.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+GeometryCache::GeometryCache(size_t resident_budget_bytes) : budget(resident_budget_bytes) {}
+
+GeometryCache::~GeometryCache() {
+  for (size_t id = 0; id < files.size(); ++id) {
+    File& file = *files[id];
+    for (uint64_t page = 0; page < file.page_count; ++page) {
+      const std::byte* address = file.pages[page].address.load();
+      if (address) unmap_page(file, page, address);
+    }
+#ifdef _WIN32
+    if (file.mapping_handle) CloseHandle(file.mapping_handle);
+    if (file.file_handle) CloseHandle(file.file_handle);
+#else
+    if (file.descriptor >= 0) close(file.descriptor);
+#endif
+  }
+}
+
+int GeometryCache::open(const std::string& path, size_t page_size) {
+  auto file = std::make_unique<File>();
+  file->path = path;
+  file->page_size = page_size;
+
+#ifdef _WIN32
+  HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (handle == INVALID_HANDLE_VALUE) {
+    std::cerr << "ERROR: Could not open geometry file '" << path << "'.\n";
+    return -1;
+  }
+  LARGE_INTEGER size;
+  GetFileSizeEx(handle, &size);
+  file->size = static_cast<uint64_t>(size.QuadPart);
+  file->file_handle = handle;
+  file->mapping_handle = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!file->mapping_handle) {
+    std::cerr << "ERROR: Could not map geometry file '" << path << "'.\n";
+    CloseHandle(handle);
+    return -1;
+  }
+#else
+  int descriptor = ::open(path.c_str(), O_RDONLY);
+  if (descriptor < 0) {
+    std::cerr << "ERROR: Could not open geometry file '" << path << "'.\n";
+    return -1;
+  }
+  struct stat info;
+  fstat(descriptor, &info);
+  file->size = static_cast<uint64_t>(info.st_size);
+  file->descriptor = descriptor;
+#endif
+
+  file->page_count = (file->size + page_size - 1) / page_size;
+  file->pages = std::make_unique<PageState[]>(file->page_count);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  files.push_back(std::move(file));
+  return static_cast<int>(files.size() - 1);
+}
+
+const std::byte* GeometryCache::pin(int id, uint64_t page) {
+  File& file = *files[id];
+  PageState& state = file.pages[page];
+
+  // Fast path: a resident page that is not being evicted. Taking the pin first guarantees the
+  // evictor can't claim the page between our check and our use of the address.
+  uint32_t previous = state.pins.fetch_add(1);
+  if (!(previous & evicting_bit)) {
+    const std::byte* address = state.address.load();
+    if (address) {
+      state.referenced.store(true, std::memory_order_relaxed);
+      return address;
+    }
+  }
+  state.pins.fetch_sub(1);
+
+  // Slow path: page fault. Eviction only happens under the mutex, so the evicting bit is
+  // never set while we hold it.
+  std::lock_guard<std::mutex> lock(mutex);
+  state.pins.fetch_add(1);
+  const std::byte* address = state.address.load();
+  if (!address) {
+    address = map_page(file, page);
+    state.address.store(address);
+    resident_pages.push_back({ id, page });
+    resident += page_length(file, page);
+    ++faults;
+    if (resident.load() > budget) evict_to_budget();
+  }
+  state.referenced.store(true, std::memory_order_relaxed);
+  return address;
+}
+
+void GeometryCache::unpin(int id, uint64_t page) {
+  files[id]->pages[page].pins.fetch_sub(1);
+}
+
+size_t GeometryCache::page_size(int id) const {
+  return files[id]->page_size;
+}
+
+uint64_t GeometryCache::page_count(int id) const {
+  return files[id]->page_count;
+}
+
+bool GeometryCache::is_resident(int id, uint64_t page) const {
+  return files[id]->pages[page].address.load() != nullptr;
+}
+
+size_t GeometryCache::page_length(const File& file, uint64_t page) const {
+  uint64_t offset = page * file.page_size;
+  return static_cast<size_t>(std::min<uint64_t>(file.page_size, file.size - offset));
+}
+
+const std::byte* GeometryCache::map_page(File& file, uint64_t page) {
+  uint64_t offset = page * file.page_size;
+  size_t length = page_length(file, page);
+
+#ifdef _WIN32
+  void* address = MapViewOfFile(file.mapping_handle, FILE_MAP_READ, static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset & 0xffffffff), length);
+  if (!address) {
+    std::cerr << "ERROR: Could not page in '" << file.path << "' page " << page << ".\n";
+    std::abort();
+  }
+#else
+  void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file.descriptor, static_cast<off_t>(offset));
+  if (address == MAP_FAILED) {
+    std::cerr << "ERROR: Could not page in '" << file.path << "' page " << page << ".\n";
+    std::abort();
+  }
+#endif
+  return static_cast<const std::byte*>(address);
+}
+
+void GeometryCache::unmap_page(File& file, uint64_t page, const std::byte* address) {
+#ifdef _WIN32
+  (void)file;
+  (void)page;
+  UnmapViewOfFile(address);
+#else
+  munmap(const_cast<std::byte*>(address), page_length(file, page));
+#endif
+}
+
+void GeometryCache::evict_to_budget() {
+  // Clock sweep over the resident pages. Pages referenced since the last sweep get a second
+  // chance; pinned pages are skipped. If everything is pinned we temporarily exceed the budget.
+  size_t steps = 2 * resident_pages.size();
+  while (resident.load() > budget && !resident_pages.empty() && steps-- > 0) {
+    if (clock_hand >= resident_pages.size()) clock_hand = 0;
+
+    ResidentPage candidate = resident_pages[clock_hand];
+    File& file = *files[candidate.file];
+    PageState& state = file.pages[candidate.page];
+
+    if (state.referenced.exchange(false)) {
+      ++clock_hand;
+      continue;
+    }
+
+    uint32_t expected = 0;
+    if (!state.pins.compare_exchange_strong(expected, evicting_bit)) {
+      ++clock_hand;
+      continue;
+    }
+
+    unmap_page(file, candidate.page, state.address.load());
+    state.address.store(nullptr);
+    state.pins.fetch_sub(evicting_bit);
+
+    resident -= page_length(file, candidate.page);
+    ++evicted;
+    resident_pages[clock_hand] = resident_pages.back();
+    resident_pages.pop_back();
+  }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Pages geometry files into memory on demand. Every file opened through the cache is split into
+// fixed-size pages. Each page is mapped read-only on first use and unmapped again when the
+// resident set exceeds the configured budget. Pages are pinned while an intersection kernel
+// reads them, and only unpinned pages are evicted (clock / second-chance policy). The budget is
+// shared by all files opened through the same cache, so a render node can cap the geometry
+// working set regardless of how many meshes the scene references.
+class GeometryCache {
+public:
+  // page_size must be a multiple of the OS mapping granularity (64 KiB on Windows).
+  static constexpr size_t default_page_size = 1 << 20;
+
+  explicit GeometryCache(size_t resident_budget_bytes);
+  ~GeometryCache();
+
+  GeometryCache(const GeometryCache&) = delete;
+  GeometryCache& operator=(const GeometryCache&) = delete;
+
+  // Opens a file for paging and returns its id. Returns -1 if the file can't be opened.
+  // Files must be opened before rendering starts.
+  int open(const std::string& path, size_t page_size = default_page_size);
+
+  // Returns the address of a resident page, mapping it in if needed. Every pin must be
+  // paired with an unpin once the caller is done reading the page.
+  const std::byte* pin(int file, uint64_t page);
+  void unpin(int file, uint64_t page);
+
+  size_t page_size(int file) const;
+  uint64_t page_count(int file) const;
+  bool is_resident(int file, uint64_t page) const;
+
+  size_t resident_budget() const { return budget; }
+  size_t resident_bytes() const { return resident.load(); }
+  uint64_t page_faults() const { return faults.load(); }
+  uint64_t evictions() const { return evicted.load(); }
+
+private:
+  static constexpr uint32_t evicting_bit = 0x80000000u;
+
+  struct PageState {
+    std::atomic<const std::byte*> address{ nullptr };
+    std::atomic<uint32_t> pins{ 0 };
+    std::atomic<bool> referenced{ false }; // Second-chance bit for the clock sweep
+  };
+
+  struct File {
+    std::string path;
+    size_t page_size = 0;
+    uint64_t size = 0;
+    uint64_t page_count = 0;
+    std::unique_ptr<PageState[]> pages;
+#ifdef _WIN32
+    void* file_handle = nullptr;
+    void* mapping_handle = nullptr;
+#else
+    int descriptor = -1;
+#endif
+  };
+
+  struct ResidentPage {
+    int file;
+    uint64_t page;
+  };
+
+  size_t budget;
+  std::atomic<size_t> resident{ 0 };
+  std::atomic<uint64_t> faults{ 0 };
+  std::atomic<uint64_t> evicted{ 0 };
+
+  std::vector<std::unique_ptr<File>> files;
+  std::vector<ResidentPage> resident_pages; // Guarded by mutex
+  size_t clock_hand = 0;                    // Guarded by mutex
+  std::mutex mutex;
+
+  size_t page_length(const File& file, uint64_t page) const;
+  const std::byte* map_page(File& file, uint64_t page);
+  void unmap_page(File& file, uint64_t page, const std::byte* address);
+  void evict_to_budget();
+};
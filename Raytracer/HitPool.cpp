@@ -1,4 +1,5 @@
 #include "HitPool.hpp"
+#include "LightBVH.hpp"
 #include "Utilities.hpp"
 #include "Shapes/Cone.hpp"
 HitPool::HitPool(std::shared_ptr<Hittable> object) { add(object); }
@@ -11,21 +12,43 @@ void HitPool::add(std::shared_ptr<Hittable> object) {
 }
 
 bool HitPool::hit(const Ray& r, Interval interval, HitRecord& rec) const {
-  HitRecord temp_rec;
+  // hit() leaves rec untouched on a miss, so candidates can be written straight into rec.
   bool hit_anything = false;
   double closest_so_far = interval.max;
 
   for (const std::shared_ptr<Hittable>& object : hit_objects) {
-    if (object->hit(r, Interval(interval.min, closest_so_far), temp_rec)) {
+    if (object->hit(r, Interval(interval.min, closest_so_far), rec)) {
       hit_anything = true;
-      closest_so_far = temp_rec.t;
-      rec = temp_rec;
+      closest_so_far = rec.t;
     }
   }
 
   return hit_anything;
 }
 
+bool HitPool::occluded(const Ray& r, Interval interval) const {
+  for (const std::shared_ptr<Hittable>& object : hit_objects)
+    if (object->occluded(r, interval))
+      return true;
+  return false;
+}
+
+void HitPool::hit_stream(std::span<const Ray> rays, Interval t, std::span<HitRecord> recs, std::span<const uint32_t> active) const {
+  // One virtual call per object for the whole stream instead of one per ray.
+  for (const std::shared_ptr<Hittable>& object : hit_objects)
+    object->hit_stream(rays, t, recs, active);
+}
+
+void HitPool::occluded_stream(std::span<const Ray> rays, Interval t, std::span<uint8_t> blocked, std::span<const uint32_t> active) const {
+  for (const std::shared_ptr<Hittable>& object : hit_objects)
+    object->occluded_stream(rays, t, blocked, active);
+}
+
+void HitPool::packet_stream(RayPacket& packet, Interval t, std::span<HitRecord> recs, uint64_t active) const {
+  for (const std::shared_ptr<Hittable>& object : hit_objects)
+    object->packet_stream(packet, t, recs, active);
+}
+
 double HitPool::pdf_value(const glm::dvec3& origin, const glm::dvec3& direction) const {
   double weight = 1.0 / hit_objects.size();
   double sum = 0.0;
@@ -38,4 +61,21 @@ double HitPool::pdf_value(const glm::dvec3& origin, const glm::dvec3& direction)
 glm::dvec3 HitPool::random(const glm::dvec3& origin) const {
   int int_size = (int)hit_objects.size();
   return hit_objects[(random_int(0, int_size-1))]->random(origin);
+}
+
+void HitPool::collect_emitters(std::vector<const Hittable*>& emitters) const {
+  for (const std::shared_ptr<Hittable>& object : hit_objects)
+    object->collect_emitters(emitters);
+}
+
+bool HitPool::light_bounds(LightBounds& bounds) const {
+  bool emits = false;
+  for (const std::shared_ptr<Hittable>& object : hit_objects) {
+    LightBounds object_bounds;
+    if (object->light_bounds(object_bounds)) {
+      bounds = emits ? LightBounds::merge(bounds, object_bounds) : object_bounds;
+      emits = true;
+    }
+  }
+  return emits;
 }
\ No newline at end of file
@@ -20,12 +20,24 @@ class HitPool: public Hittable {
 
     bool hit(const Ray& ray, Interval t, HitRecord& rec) const override;
 
+    bool occluded(const Ray& ray, Interval t) const override;
+
+    void hit_stream(std::span<const Ray> rays, Interval t, std::span<HitRecord> recs, std::span<const uint32_t> active) const override;
+
+    void occluded_stream(std::span<const Ray> rays, Interval t, std::span<uint8_t> blocked, std::span<const uint32_t> active) const override;
+
+    void packet_stream(RayPacket& packet, Interval t, std::span<HitRecord> recs, uint64_t active) const override;
+
     AABB bounding_box() const override { return bbox; }
 
     double pdf_value(const glm::dvec3& origin, const glm::dvec3& direction) const override;
 
     glm::dvec3 random(const glm::dvec3& origin) const override;
 
+    void collect_emitters(std::vector<const Hittable*>& emitters) const override;
+
+    bool light_bounds(LightBounds& bounds) const override;
+
   private:
     AABB bbox;
 };
\ No newline at end of file
@@ -1,4 +1,80 @@
 #include "Hittable.hpp"
+#include "LightBVH.hpp"
+#include "RayPacket.hpp"
+
+#include <numeric>
+#include <vector>
+
+bool Hittable::occluded(const Ray& r, Interval t) const {
+  HitRecord rec;
+  return hit(r, t, rec);
+}
+
+size_t Hittable::hit_batch(std::span<const Ray> rays, Interval t, std::span<HitRecord> recs) const {
+  thread_local std::vector<uint32_t> active;
+  active.resize(rays.size());
+  std::iota(active.begin(), active.end(), 0u);
+
+  for (size_t i = 0; i < rays.size(); ++i) {
+    recs[i].t = t.max;
+    recs[i].prim = nullptr;
+  }
+
+  hit_stream(rays, t, recs, active);
+
+  size_t hits = 0;
+  for (size_t i = 0; i < rays.size(); ++i) {
+    if (!recs[i].prim) continue;
+    recs[i].prim->surface_interaction(rays[i], recs[i]);
+    ++hits;
+  }
+  return hits;
+}
+
+void Hittable::occluded_batch(std::span<const Ray> rays, Interval t, std::span<uint8_t> blocked) const {
+  thread_local std::vector<uint32_t> active;
+  active.resize(rays.size());
+  std::iota(active.begin(), active.end(), 0u);
+  std::fill(blocked.begin(), blocked.begin() + rays.size(), uint8_t(0));
+
+  occluded_stream(rays, t, blocked, active);
+}
+
+void Hittable::hit_stream(std::span<const Ray> rays, Interval t, std::span<HitRecord> recs, std::span<const uint32_t> active) const {
+  for (uint32_t i : active)
+    hit(rays[i], Interval(t.min, recs[i].t), recs[i]);
+}
+
+void Hittable::occluded_stream(std::span<const Ray> rays, Interval t, std::span<uint8_t> blocked, std::span<const uint32_t> active) const {
+  for (uint32_t i : active)
+    if (!blocked[i] && occluded(rays[i], t)) blocked[i] = 1;
+}
+
+size_t Hittable::hit_packet(RayPacket& packet, Interval t, std::span<HitRecord> recs) const {
+  for (int i = 0; i < packet.size(); ++i) {
+    packet.t_max[i] = t.max;
+    recs[i].t = t.max;
+    recs[i].prim = nullptr;
+  }
+
+  packet_stream(packet, t, recs, packet.all());
+
+  size_t hits = 0;
+  for (int i = 0; i < packet.size(); ++i) {
+    if (!recs[i].prim) continue;
+    recs[i].prim->surface_interaction(packet.ray(i), recs[i]);
+    ++hits;
+  }
+  return hits;
+}
+
+void Hittable::packet_stream(RayPacket& packet, Interval t, std::span<HitRecord> recs, uint64_t active) const {
+  for (int i = 0; i < packet.size(); ++i) {
+    if (!(active & (uint64_t(1) << i))) continue;
+    if (hit(packet.ray(i), Interval(t.min, packet.t_max[i]), recs[i]))
+      packet.t_max[i] = recs[i].t;
+  }
+}
 
 bool Translate::hit(const Ray& r, Interval t, HitRecord& rec) const {
   // Move the ray backwards by the offset
@@ -8,16 +84,47 @@ bool Translate::hit(const Ray& r, Interval t, HitRecord& rec) const {
   if (!hittable->hit(offset_r, t, rec))
     return false;
 
+  rec.push_instance(this);
+  return true;
+}
+
+void Translate::surface_interaction(const Ray& r, HitRecord& rec) const {
+  Ray offset_r(r.origin() - offset, r.direction(), r.time());
+  rec.pop_instance()->surface_interaction(offset_r, rec);
+
   // Move the intersection point forwards by the offset
   rec.p += offset;
-
-  return true;
 }
 
 bool Translate::contains(const glm::dvec3& p) const {
   return hittable->contains(p - offset);
 }
 
+double Translate::pdf_value(const glm::dvec3& origin, const glm::dvec3& direction) const {
+  return hittable->pdf_value(origin - offset, direction);
+}
+
+glm::dvec3 Translate::random(const glm::dvec3& origin) const {
+  return hittable->random(origin - offset);
+}
+
+glm::dvec3 Translate::sample_direction(const glm::dvec3& origin, double& pdf) const {
+  return hittable->sample_direction(origin - offset, pdf);
+}
+
+void Translate::collect_emitters(std::vector<const Hittable*>& emitters) const {
+  // The instance is the prim its hits report, so it stands in for everything it wraps.
+  std::vector<const Hittable*> inner;
+  hittable->collect_emitters(inner);
+  if (!inner.empty()) emitters.push_back(this);
+}
+
+bool Translate::light_bounds(LightBounds& bounds) const {
+  if (!hittable->light_bounds(bounds)) return false;
+  bounds.bounds = bounds.bounds + offset;
+  return true;
+}
+
 RotateYAxis::RotateYAxis(std::shared_ptr<Hittable> object, double angle)
   : hittable(object) {
   double radians = glm::radians(angle);
@@ -53,29 +160,26 @@ RotateYAxis::RotateYAxis(std::shared_ptr<Hittable> object, double angle)
 }
 
 bool RotateYAxis::hit(const Ray& r, Interval ray_t, HitRecord& rec) const {
-
-  // Transform the ray from world space to object space.
-
-  auto origin = glm::dvec3((cos_theta * r.origin().x) - (sin_theta * r.origin().z), r.origin().y, (sin_theta * r.origin().x) + (cos_theta * r.origin().z));
-
-  auto direction = glm::dvec3((cos_theta * r.direction().x) - (sin_theta * r.direction().z), r.direction().y, (sin_theta * r.direction().x) + (cos_theta * r.direction().z));
-
-  Ray rotated_r(origin, direction, r.time());
-
   // Determine whether an intersection exists in object space (and if so, where).
-
-  if (!hittable->hit(rotated_r, ray_t, rec))
+  // The rotation keeps the direction's length, so t is the same in both spaces.
+  if (!hittable->hit(object_ray(r), ray_t, rec))
     return false;
 
-  // Transform the intersection from object space back to world space.
-
-  rec.p = glm::dvec3((cos_theta * rec.p.x) + (sin_theta * rec.p.z), rec.p.y, (-sin_theta * rec.p.x) + (cos_theta * rec.p.z));
+  rec.push_instance(this);
+  rec.shape_ptr = this;
+  return true;
+}
 
-  rec.normal = glm::dvec3((cos_theta * rec.normal.x) + (sin_theta * rec.normal.z), rec.normal.y, (-sin_theta * rec.normal.x) + (cos_theta * rec.normal.z));
+void RotateYAxis::surface_interaction(const Ray& r, HitRecord& rec) const {
+  rec.pop_instance()->surface_interaction(object_ray(r), rec);
 
-  rec.shape_ptr = this;
+  // Transform the intersection from object space back to world space.
+  rec.p = rotate_y(rec.p);
+  rec.normal = rotate_y(rec.normal);
+}
 
-  return true;
+Ray RotateYAxis::object_ray(const Ray& r) const {
+  return Ray(inverse_rotate_y(r.origin()), inverse_rotate_y(r.direction()), r.time());
 }
 
 bool RotateYAxis::contains(const glm::dvec3& p) const {
@@ -110,3 +214,21 @@ glm::dvec3 RotateYAxis::random(const glm::dvec3& origin) const {
   glm::dvec3 random_local = hittable->random(origin_local);
   return rotate_y(random_local);
 }
+
+glm::dvec3 RotateYAxis::sample_direction(const glm::dvec3& origin, double& pdf) const {
+  glm::dvec3 origin_local = inverse_rotate_y(origin);
+  return rotate_y(hittable->sample_direction(origin_local, pdf));
+}
+
+void RotateYAxis::collect_emitters(std::vector<const Hittable*>& emitters) const {
+  std::vector<const Hittable*> inner;
+  hittable->collect_emitters(inner);
+  if (!inner.empty()) emitters.push_back(this);
+}
+
+bool RotateYAxis::light_bounds(LightBounds& bounds) const {
+  if (!hittable->light_bounds(bounds)) return false;
+  bounds.bounds = bbox;
+  bounds.w = rotate_y(bounds.w);
+  return true;
+}
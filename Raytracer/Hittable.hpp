@@ -3,23 +3,58 @@
 #include "Ray.hpp"
 #include "Interval.hpp"
 #include "AABB.hpp"
+#include <cstdint>
 #include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
 #include <glm/glm.hpp>
 
 class Material; // Forward declaration of Material class
 class Hittable;
-
+class RayPacket;
+struct LightBounds;
+
+// Intersection is split in two phases. Hittable::hit() only fills t, prim, prim_id and the
+// primitive's parametric/barycentric coordinates in u, v. The remaining fields are filled by
+// prim->surface_interaction(), which callers run once for the final closest hit.
+//
+// An instance that wraps the hit reports itself as prim and pushes the prim it wrapped on
+// instanced, so its own surface_interaction() can pop it and resolve the hit in object space.
+// Up to max_instance_depth instances can be nested around a primitive.
+//
+// The record is trivially copyable (136 bytes) so hit records can be copied around traversal
+// code without touching shared state. The material is a non-owning pointer; shapes keep their
+// materials alive through their own shared_ptr for the lifetime of the scene.
 class HitRecord {
   public:
-    glm::dvec3 p;                       ///< Point of intersection
-    glm::dvec3 normal;                  ///< Normal at the intersection point
-    std::shared_ptr<Material> material; ///< Material at the intersection point
-    double t;                           ///< Time t at the intersection
-    double u;                           ///< Texture coordinate u
-    double v;                           ///< Texture coordinate v
-    bool front_face;                    ///< Indicates if the ray hit the front face of the object
+    glm::dvec3 p;               ///< Point of intersection
+    glm::dvec3 normal;          ///< Normal at the intersection point
+    double t;                   ///< Time t at the intersection
+    double u;                   ///< Texture coordinate u (barycentric/parametric until resolved)
+    double v;                   ///< Texture coordinate v (barycentric/parametric until resolved)
+    const Material* material;   ///< Material at the intersection point, owned by the shape
+    const Hittable* prim;       ///< Primitive that computes the surface attributes of this hit
+    const Hittable* shape_ptr;  ///< We use this to cast into the actual shape in subsurface Scattering
+    uint32_t prim_id;           ///< Primitive specific id, e.g. the triangle index inside a mesh
+    bool front_face;            ///< Indicates if the ray hit the front face of the object
+
+    static constexpr int max_instance_depth = 4;
+    const Hittable* instanced[max_instance_depth]; ///< Prims wrapped by the instances around prim, outermost first
+
+    // Called by an instance whose child reported this hit: the instance becomes prim.
+    void push_instance(const Hittable* instance) {
+        for (int i = max_instance_depth - 1; i > 0; --i) instanced[i] = instanced[i - 1];
+        instanced[0] = prim;
+        prim = instance;
+    }
 
-    const Hittable* shape_ptr; ///< We use this to cast into the actual shape in subsurface Scattering
+    // Called by the instance's surface_interaction(): the prim it wrapped, which resolves the hit.
+    const Hittable* pop_instance() {
+        const Hittable* inner = instanced[0];
+        for (int i = 0; i < max_instance_depth - 1; ++i) instanced[i] = instanced[i + 1];
+        return inner;
+    }
 
     void set_face_normal(const Ray& r, const glm::dvec3& outward_normal) {
         front_face = glm::dot(r.direction(), outward_normal) < 0;
@@ -27,14 +62,45 @@ class HitRecord {
     }
 };
 
+static_assert(std::is_trivially_copyable_v<HitRecord>, "HitRecord is copied per candidate hit, keep it trivial");
+
 class Hittable {
   public:
     // Virtual destructor for proper cleanup of derived classes
     virtual ~Hittable() = default;
 
-    // Check if the ray intersects with the object
+    // Check if the ray intersects with the object. Only records t, prim, prim_id and u, v, and
+    // leaves rec untouched when it returns false.
     virtual bool hit(const Ray& r, Interval t, HitRecord& rec) const = 0;
 
+    // Fill in p, normal, front_face, material and texture coordinates of a hit returned by hit().
+    virtual void surface_interaction(const Ray& /*r*/, HitRecord& /*rec*/) const {}
+
+    // Any-hit query, true if anything blocks the ray inside the interval.
+    virtual bool occluded(const Ray& r, Interval t) const;
+
+    // Batched queries over many rays at once. hit_batch() finds and resolves the closest hit of
+    // every ray and returns the number of rays that hit something; misses are marked with
+    // recs[i].prim == nullptr. occluded_batch() sets blocked[i] to 1 for every occluded ray.
+    size_t hit_batch(std::span<const Ray> rays, Interval t, std::span<HitRecord> recs) const;
+    void occluded_batch(std::span<const Ray> rays, Interval t, std::span<uint8_t> blocked) const;
+
+    // Stream traversal behind the batched queries. Only the rays listed in active are processed.
+    // hit_stream() clips each ray against recs[i].t, so a closer hit found by a previous call is
+    // kept. The defaults loop over hit() and occluded(); aggregates override them to test each
+    // bounding box against the whole stream and dispatch once per child instead of once per ray.
+    virtual void hit_stream(std::span<const Ray> rays, Interval t, std::span<HitRecord> recs, std::span<const uint32_t> active) const;
+    virtual void occluded_stream(std::span<const Ray> rays, Interval t, std::span<uint8_t> blocked, std::span<const uint32_t> active) const;
+
+    // Closest hits of a packet of coherent rays, resolved like hit_batch(): misses are marked with
+    // recs[i].prim == nullptr and the number of hits is returned.
+    size_t hit_packet(RayPacket& packet, Interval t, std::span<HitRecord> recs) const;
+
+    // Packet traversal behind hit_packet(), over the lanes set in active. Each lane is clipped
+    // against packet.t_max, which is lowered whenever a closer hit is found. The default runs hit()
+    // per lane; aggregates override it to cull their boxes for the whole packet at once.
+    virtual void packet_stream(RayPacket& packet, Interval t, std::span<HitRecord> recs, uint64_t active) const;
+
     virtual bool contains(const glm::dvec3& /*p*/) const { return false; }
 
     virtual AABB bounding_box() const = 0; ///< Get the bounding box of the object
@@ -47,11 +113,31 @@ class Hittable {
       return glm::dvec3(1, 0, 0);
     }
 
+    // random() and the pdf_value() of the direction it returns, in one go. Shapes whose sampler
+    // already knows its density override this to skip the intersection pdf_value() needs.
+    virtual glm::dvec3 sample_direction(const glm::dvec3& origin, double& pdf) const {
+      glm::dvec3 direction = random(origin);
+      pdf = pdf_value(origin, direction);
+      return direction;
+    }
+
     virtual glm::dvec3 normal_at(const glm::dvec3& /*p**/) const {
       return glm::dvec3(0.0); // Default fallback
     }
+
+    // Appends the light sources found in this object for the LightBVH. An emitter is the object a
+    // hit reports as HitRecord::prim, so aggregates and composite shapes forward to their children
+    // while instances register themselves. Emitters must implement pdf_value(), random() and
+    // light_bounds().
+    virtual void collect_emitters(std::vector<const Hittable*>& /*emitters*/) const {}
+
+    // Power and orientation bounds of the light emitted by this object. Returns false if it emits nothing.
+    virtual bool light_bounds(LightBounds& /*bounds*/) const { return false; }
 };
 
+// Instances report themselves as the prim of the hits inside them. Their surface_interaction()
+// rebuilds the object space ray, lets the wrapped prim resolve the hit there and transforms the
+// result to world space, so the work is only done for the final closest hit.
 class Translate : public Hittable {
   public:
     Translate(std::shared_ptr<Hittable> hittable, const glm::dvec3& offset)
@@ -61,9 +147,21 @@ class Translate : public Hittable {
 
     bool hit(const Ray& r, Interval t, HitRecord& rec) const override;
 
+    void surface_interaction(const Ray& r, HitRecord& rec) const override;
+
     bool contains(const glm::dvec3& p) const override;
 
     inline AABB bounding_box() const override { return bbox; }
+
+    double pdf_value(const glm::dvec3& origin, const glm::dvec3& direction) const override;
+
+    glm::dvec3 random(const glm::dvec3& origin) const override;
+
+    glm::dvec3 sample_direction(const glm::dvec3& origin, double& pdf) const override;
+
+    void collect_emitters(std::vector<const Hittable*>& emitters) const override;
+
+    bool light_bounds(LightBounds& bounds) const override;
   
   private:
     std::shared_ptr<Hittable> hittable; ///< Pointer to the hittable object
@@ -76,10 +174,14 @@ class RotateYAxis : public Hittable {
 public:
   RotateYAxis(std::shared_ptr<Hittable> object, double angle);
   bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override;
+  void surface_interaction(const Ray& r, HitRecord& rec) const override;
   bool contains(const glm::dvec3& p) const override;
   inline AABB bounding_box() const override { return bbox; }
   double pdf_value(const glm::dvec3& origin, const glm::dvec3& direction) const override;
   glm::dvec3 random(const glm::dvec3& origin) const override;
+  glm::dvec3 sample_direction(const glm::dvec3& origin, double& pdf) const override;
+  void collect_emitters(std::vector<const Hittable*>& emitters) const override;
+  bool light_bounds(LightBounds& bounds) const override;
 private:
   std::shared_ptr<Hittable> hittable;
   double sin_theta;
@@ -88,4 +190,5 @@ private:
 
   glm::dvec3 rotate_y(const glm::dvec3& p) const;
   glm::dvec3 inverse_rotate_y(const glm::dvec3& p) const;
+  Ray object_ray(const Ray& r) const;
 };
\ No newline at end of file
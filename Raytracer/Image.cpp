@@ -0,0 +1,193 @@
+#include "Image.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+
+namespace {
+  uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static const std::array<uint32_t, 256> table = [] {
+      std::array<uint32_t, 256> entries;
+      for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k)
+          c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        entries[n] = c;
+      }
+      return entries;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+      crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+  }
+
+  void append_be32(std::vector<uint8_t>& bytes, uint32_t value) {
+    bytes.push_back(uint8_t(value >> 24));
+    bytes.push_back(uint8_t(value >> 16));
+    bytes.push_back(uint8_t(value >> 8));
+    bytes.push_back(uint8_t(value));
+  }
+
+  void write_png_chunk(std::ostream& out, const char type[4], const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> chunk;
+    chunk.reserve(data.size() + 12);
+    append_be32(chunk, uint32_t(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    append_be32(chunk, crc32(chunk.data() + 4, data.size() + 4));
+    out.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+  }
+
+  void write_ppm_ascii(std::ostream& out, const std::vector<uint8_t>& rgb) {
+    // Formatted into one buffer with to_chars rather than value by value through the stream.
+    std::vector<char> text(rgb.size() * 4);
+    char* end = text.data();
+    for (size_t i = 0; i < rgb.size(); i += 3) {
+      for (int c = 0; c < 3; ++c) {
+        end = std::to_chars(end, text.data() + text.size(), rgb[i + c]).ptr;
+        *end++ = c < 2 ? ' ' : '\n';
+      }
+    }
+    out.write(text.data(), end - text.data());
+  }
+}
+
+std::vector<uint8_t> to_display(std::span<const glm::vec3> linear, Tonemap tonemap, float exposure) {
+  static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "Pixels are read as a flat array of floats");
+  const float* values = linear.empty() ? nullptr : &linear[0].x;
+  const size_t count = linear.size() * 3;
+  const float scale = std::exp2(exposure);
+  std::vector<uint8_t> bytes(count);
+
+  auto transform = [&](auto curve) {
+    for (size_t i = 0; i < count; ++i) {
+      float x = values[i] * scale;
+      x = x > 0.0f ? x : 0.0f; // Also catches NaN
+      x = std::min(std::sqrt(curve(x)), 0.999f);
+      bytes[i] = uint8_t(int(256.0f * x));
+    }
+  };
+  switch (tonemap) {
+  case Tonemap::reinhard:
+    transform([](float x) { return x / (1.0f + x); });
+    break;
+  case Tonemap::aces:
+    transform([](float x) { return (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f); });
+    break;
+  default:
+    transform([](float x) { return x; });
+    break;
+  }
+  return bytes;
+}
+
+ImageFormat format_from_extension(const std::string& path) {
+  std::string extension = path.substr(std::min(path.find_last_of('.'), path.size()));
+  std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+  if (extension == ".pfm") return ImageFormat::pfm;
+  if (extension == ".png") return ImageFormat::png;
+  return ImageFormat::ppm;
+}
+
+bool write_image(std::ostream& out, int width, int height, std::span<const glm::vec3> linear, ImageFormat format, Tonemap tonemap, float exposure) {
+  ImageStream stream(out, width, height, format, tonemap, exposure);
+  return stream.write_rows(linear) && stream.finish();
+}
+
+bool write_image(const std::string& path, int width, int height, std::span<const glm::vec3> linear, ImageFormat format, Tonemap tonemap, float exposure) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  return out && write_image(out, width, height, linear, format, tonemap, exposure);
+}
+
+ImageStream::ImageStream(std::ostream& out, int width, int height, ImageFormat format, Tonemap tonemap, float exposure)
+  : out(out), width(width), height(height), format(format), tonemap(tonemap), exposure(exposure) {
+  switch (format) {
+  case ImageFormat::ppm_ascii:
+    out << "P3\n" << width << ' ' << height << "\n255\n";
+    break;
+  case ImageFormat::pfm:
+    // A negative scale marks little endian data.
+    out << "PF\n" << width << ' ' << height << '\n' << (std::endian::native == std::endian::little ? "-1.0" : "1.0") << '\n';
+    break;
+  case ImageFormat::png: {
+    static constexpr uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    out.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+    std::vector<uint8_t> header;
+    append_be32(header, uint32_t(width));
+    append_be32(header, uint32_t(height));
+    header.insert(header.end(), { 8, 2, 0, 0, 0 }); // 8 bit RGB, deflate, adaptive filtering, no interlace
+    write_png_chunk(out, "IHDR", header);
+    break;
+  }
+  default:
+    out << "P6\n" << width << ' ' << height << "\n255\n";
+    break;
+  }
+}
+
+bool ImageStream::write_rows(std::span<const glm::vec3> rows) {
+  const int count = int(rows.size() / width);
+  if (format == ImageFormat::pfm) {
+    for (int y = count - 1; y >= 0; --y)
+      out.write(reinterpret_cast<const char*>(rows.data() + size_t(y) * width), size_t(width) * sizeof(glm::vec3));
+  }
+  else {
+    const std::vector<uint8_t> rgb = to_display(rows, tonemap, exposure);
+    if (format == ImageFormat::ppm_ascii) {
+      write_ppm_ascii(out, rgb);
+    }
+    else if (format == ImageFormat::png) {
+      // Each band is an IDAT chunk of stored (uncompressed) deflate blocks: no compressor to carry
+      // around, and the file is still a third of a P3 one. Every row starts with its filter type, 0
+      // (none). The final block and the Adler-32 come with finish().
+      const size_t row_size = size_t(width) * 3;
+      std::vector<uint8_t> raw;
+      raw.reserve((row_size + 1) * count);
+      for (int y = 0; y < count; ++y) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgb.begin() + y * row_size, rgb.begin() + (y + 1) * row_size);
+      }
+      for (uint8_t byte : raw) {
+        adler_a = (adler_a + byte) % 65521;
+        adler_b = (adler_b + adler_a) % 65521;
+      }
+
+      std::vector<uint8_t> zlib;
+      if (rows_written == 0)
+        zlib = { 0x78, 0x01 };
+      zlib.reserve(zlib.size() + raw.size() + (raw.size() / 65535 + 1) * 5);
+      for (size_t first = 0; first < raw.size(); first += 65535) {
+        const size_t size = std::min<size_t>(65535, raw.size() - first);
+        zlib.insert(zlib.end(), { 0, uint8_t(size), uint8_t(size >> 8), uint8_t(~size), uint8_t(~size >> 8) });
+        zlib.insert(zlib.end(), raw.begin() + first, raw.begin() + first + size);
+      }
+      write_png_chunk(out, "IDAT", zlib);
+    }
+    else {
+      out.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+    }
+  }
+  rows_written += count;
+  out.flush();
+  return bool(out);
+}
+
+bool ImageStream::finish() {
+  if (format == ImageFormat::png) {
+    std::vector<uint8_t> zlib;
+    if (rows_written == 0)
+      zlib = { 0x78, 0x01 };
+    zlib.insert(zlib.end(), { 1, 0, 0, 0xff, 0xff }); // Empty final block
+    append_be32(zlib, (adler_b << 16) | adler_a);
+    write_png_chunk(out, "IDAT", zlib);
+    write_png_chunk(out, "IEND", {});
+  }
+  out.flush();
+  return bool(out) && rows_written == height;
+}
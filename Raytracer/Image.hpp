@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+enum class ImageFormat {
+  ppm_ascii, // Plain text P3, 8 bit
+  ppm,       // Binary P6, 8 bit
+  pfm,       // Portable float map: linear radiance, unclamped
+  png,       // 8 bit RGB
+};
+
+enum class Tonemap {
+  clamp,    // Clips at 1
+  reinhard, // x / (1 + x): compresses the highlights instead of clipping them
+  aces,     // Filmic curve, Narkowicz's fit of the ACES reference transform
+};
+
+// Display transform: exposure, tonemap, gamma 2 and quantization of linear radiance to 8 bit, as
+// one branch free loop per tonemap over the float components so the compiler vectorizes it. NaNs
+// become 0. With Tonemap::clamp and no exposure it matches write_color() byte for byte.
+std::vector<uint8_t> to_display(std::span<const glm::vec3> linear, Tonemap tonemap = Tonemap::clamp, float exposure = 0.0f);
+
+// Format from the extension of path: .pfm, .png or .ppm (binary).
+ImageFormat format_from_extension(const std::string& path);
+
+// Writes width x height pixels of linear radiance, rows top to bottom. The 8 bit formats go
+// through to_display(); PFM keeps the values as they are. out must be opened in binary mode for
+// anything but ppm_ascii.
+bool write_image(std::ostream& out, int width, int height, std::span<const glm::vec3> linear, ImageFormat format,
+                 Tonemap tonemap = Tonemap::clamp, float exposure = 0.0f);
+bool write_image(const std::string& path, int width, int height, std::span<const glm::vec3> linear, ImageFormat format,
+                 Tonemap tonemap = Tonemap::clamp, float exposure = 0.0f);
+
+// Writes an image a band of rows at a time, so the whole image never has to be in memory. The
+// output only ever grows: bands are appended in file order, top to bottom except for PFM, which
+// stores its rows bottom to top, and the stream is flushed after each one so other programs can
+// read the rows written so far while the rest is rendered. The header goes out on construction.
+class ImageStream {
+public:
+  ImageStream(std::ostream& out, int width, int height, ImageFormat format, Tonemap tonemap = Tonemap::clamp, float exposure = 0.0f);
+
+  // Whether bands must come from the bottom of the image up.
+  bool bottom_up() const { return format == ImageFormat::pfm; }
+
+  // Appends rows, whole image rows given top to bottom, next to the rows written so far in file order.
+  bool write_rows(std::span<const glm::vec3> rows);
+
+  // Ends the file, once every row is written.
+  bool finish();
+
+private:
+  std::ostream& out;
+  int width;
+  int height;
+  ImageFormat format;
+  Tonemap tonemap;
+  float exposure;
+  int rows_written = 0;
+  uint32_t adler_a = 1; // PNG: Adler-32 of the image data so far
+  uint32_t adler_b = 0;
+};
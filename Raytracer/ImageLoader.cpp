@@ -66,6 +66,18 @@ const unsigned char* Image::pixel_data(int x, int y) const {
   return bdata + y * bytes_per_scanline + x * bytes_per_pixel;
 }
 
+const float* Image::linear_pixel_data(int x, int y) const {
+  // Return the address of the three linear RGB floats of the pixel at x,y, unclamped: HDR files
+  // keep their full range. If there is no image data, returns magenta.
+  static float magenta[] = { 1.0f, 0.0f, 1.0f };
+  if (fdata == nullptr) return magenta;
+
+  x = clamp(x, 0, image_width);
+  y = clamp(y, 0, image_height);
+
+  return fdata + y * bytes_per_scanline + x * bytes_per_pixel;
+}
+
 
 void Image::convert_to_bytes() {
   // Convert the linear floating point pixel data to bytes, storing the resulting byte
@@ -16,6 +16,8 @@ public:
 
   const unsigned char* pixel_data(int x, int y) const;
 
+  const float* linear_pixel_data(int x, int y) const;
+
 private:
   const int      bytes_per_pixel = 3;
   float* fdata = nullptr;         // Linear floating point pixel data
@@ -0,0 +1,228 @@
+#include "LightBVH.hpp"
+#include "Utilities.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+namespace {
+  double safe_sqrt(double x) {
+    return std::sqrt(std::max(0.0, x));
+  }
+
+  double safe_acos(double x) {
+    return std::acos(std::clamp(x, -1.0, 1.0));
+  }
+
+  // cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b.
+  double cos_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+    if (cos_a > cos_b) return 1.0;
+    return cos_a * cos_b + sin_a * sin_b;
+  }
+
+  double sin_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+    if (cos_a > cos_b) return 0.0;
+    return sin_a * cos_b - cos_a * sin_b;
+  }
+
+  glm::dvec3 rotate(const glm::dvec3& v, const glm::dvec3& axis, double angle) {
+    // Rodrigues' rotation formula, axis must be normalized.
+    double c = std::cos(angle);
+    double s = std::sin(angle);
+    return v * c + glm::cross(axis, v) * s + axis * glm::dot(axis, v) * (1.0 - c);
+  }
+
+  glm::dvec3 bounds_min(const AABB& b) { return glm::dvec3(b.x.min, b.y.min, b.z.min); }
+  glm::dvec3 bounds_max(const AABB& b) { return glm::dvec3(b.x.max, b.y.max, b.z.max); }
+
+  constexpr double one_minus_epsilon = 0x1.fffffffffffffp-1; // Largest double below 1
+}
+
+double LightBounds::importance(const glm::dvec3& p) const {
+  if (phi <= 0.0) return 0.0;
+
+  glm::dvec3 p_min = bounds_min(bounds);
+  glm::dvec3 p_max = bounds_max(bounds);
+  glm::dvec3 center = 0.5 * (p_min + p_max);
+
+  // Clamp the distance so receivers close to or inside the bounds don't blow up the estimate.
+  double d2 = glm::length2(p - center);
+  d2 = std::max(d2, glm::length(p_max - p_min) / 2.0);
+
+  bool inside = bounds.x.contains(p.x) && bounds.y.contains(p.y) && bounds.z.contains(p.z);
+  if (inside) return phi / d2;
+
+  // Angle between w and the direction to p, reduced by the normal cone and by the cone of
+  // directions from p that hit the bounds.
+  glm::dvec3 wi = glm::normalize(p - center);
+  double cos_theta_w = glm::dot(w, wi);
+  if (two_sided) cos_theta_w = std::abs(cos_theta_w);
+  double sin_theta_w = safe_sqrt(1.0 - cos_theta_w * cos_theta_w);
+
+  double sin2_theta_b = glm::length2(p_max - center) / glm::length2(p - center);
+  double cos_theta_b = sin2_theta_b >= 1.0 ? -1.0 : safe_sqrt(1.0 - sin2_theta_b);
+  double sin_theta_b = safe_sqrt(1.0 - cos_theta_b * cos_theta_b);
+
+  double sin_theta_o = safe_sqrt(1.0 - cos_theta_o * cos_theta_o);
+  double cos_theta_x = cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+  double sin_theta_x = sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+  double cos_theta_p = cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+  if (cos_theta_p <= cos_theta_e) return 0.0;
+
+  return phi * cos_theta_p / d2;
+}
+
+LightBounds LightBounds::merge(const LightBounds& a, const LightBounds& b) {
+  if (a.phi <= 0.0) return b;
+  if (b.phi <= 0.0) return a;
+
+  LightBounds merged;
+  merged.bounds = AABB(a.bounds, b.bounds);
+  merged.phi = a.phi + b.phi;
+  merged.cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e);
+  merged.two_sided = a.two_sided || b.two_sided;
+
+  // Smallest cone containing both normal cones.
+  double theta_a = safe_acos(a.cos_theta_o);
+  double theta_b = safe_acos(b.cos_theta_o);
+  double theta_d = safe_acos(glm::dot(a.w, b.w));
+  if (std::min(theta_d + theta_b, pi) <= theta_a) {
+    merged.w = a.w;
+    merged.cos_theta_o = a.cos_theta_o;
+    return merged;
+  }
+  if (std::min(theta_d + theta_a, pi) <= theta_b) {
+    merged.w = b.w;
+    merged.cos_theta_o = b.cos_theta_o;
+    return merged;
+  }
+
+  double theta_o = (theta_a + theta_d + theta_b) / 2.0;
+  glm::dvec3 axis = glm::cross(a.w, b.w);
+  if (theta_o >= pi || glm::length2(axis) == 0.0) {
+    merged.w = a.w;
+    merged.cos_theta_o = -1.0; // Entire sphere
+    return merged;
+  }
+
+  merged.w = rotate(a.w, glm::normalize(axis), theta_o - theta_a);
+  merged.cos_theta_o = std::cos(theta_o);
+  return merged;
+}
+
+LightBVH::LightBVH(const Hittable& world) {
+  std::vector<const Hittable*> emitters;
+  world.collect_emitters(emitters);
+
+  // An emitter added to the world more than once gets a single leaf: pmf() follows one trail per
+  // light, which must be the only way sample() can reach it.
+  std::unordered_set<const Hittable*> seen;
+  std::vector<Item> items;
+  for (const Hittable* emitter : emitters) {
+    if (!seen.insert(emitter).second) continue;
+    LightBounds bounds;
+    if (emitter->light_bounds(bounds) && bounds.phi > 0.0)
+      items.emplace_back(emitter, bounds);
+  }
+
+  if (items.empty()) return;
+
+  nodes.reserve(2 * items.size() - 1);
+  lights.reserve(items.size());
+  build(items, 0, items.size(), 0, 0);
+}
+
+uint32_t LightBVH::build(std::vector<Item>& items, size_t start, size_t end, uint64_t trail, int depth) {
+  uint32_t node_index = static_cast<uint32_t>(nodes.size());
+  nodes.emplace_back();
+
+  if (end - start == 1) {
+    trails[items[start].first] = trail;
+    nodes[node_index] = { items[start].second, static_cast<uint32_t>(lights.size()), true };
+    lights.push_back(items[start].first);
+    return node_index;
+  }
+
+  // Median split along the longest axis of the light centroids.
+  AABB centroids;
+  for (size_t i = start; i < end; ++i) {
+    glm::dvec3 c = 0.5 * (bounds_min(items[i].second.bounds) + bounds_max(items[i].second.bounds));
+    centroids = AABB(centroids, AABB(c, c));
+  }
+  int axis = centroids.longest_axis();
+  size_t mid = start + (end - start) / 2;
+  std::nth_element(items.begin() + start, items.begin() + mid, items.begin() + end, [axis](const Item& a, const Item& b) {
+    return a.second.bounds.axis_interval(axis).min + a.second.bounds.axis_interval(axis).max
+         < b.second.bounds.axis_interval(axis).min + b.second.bounds.axis_interval(axis).max;
+  });
+
+  uint32_t first = build(items, start, mid, trail, depth + 1);
+  uint32_t second = build(items, mid, end, trail | (uint64_t(1) << depth), depth + 1);
+
+  nodes[node_index] = { LightBounds::merge(nodes[first].bounds, nodes[second].bounds), second, false };
+  return node_index;
+}
+
+const Hittable* LightBVH::sample(const glm::dvec3& p, double& pmf) const {
+  pmf = 0.0;
+  if (nodes.empty()) return nullptr;
+
+  // A single uniform, rescaled to [0, 1) after every choice (as PBRT does), so a pick always takes
+  // exactly one sampler dimension whatever the path down the tree.
+  double u = random_double();
+  double probability = 1.0;
+  uint32_t current = 0;
+  while (!nodes[current].leaf) {
+    double first = nodes[current + 1].bounds.importance(p);
+    double second = nodes[nodes[current].offset].bounds.importance(p);
+    if (first <= 0.0 && second <= 0.0) return nullptr;
+
+    double p_first = first / (first + second);
+    if (u < p_first) {
+      u = std::min(u / p_first, one_minus_epsilon);
+      probability *= p_first;
+      current = current + 1;
+    } else {
+      u = std::min((u - p_first) / (1.0 - p_first), one_minus_epsilon);
+      probability *= 1.0 - p_first;
+      current = nodes[current].offset;
+    }
+  }
+
+  if (nodes[current].bounds.importance(p) <= 0.0) return nullptr;
+  pmf = probability;
+  return lights[nodes[current].offset];
+}
+
+double LightBVH::pmf(const glm::dvec3& p, const Hittable* light) const {
+  auto it = trails.find(light);
+  if (it == trails.end()) return 0.0;
+
+  // Walk down the light's path, multiplying the probability of each choice sample() would make.
+  uint64_t trail = it->second;
+  double probability = 1.0;
+  uint32_t current = 0;
+  while (!nodes[current].leaf) {
+    double first = nodes[current + 1].bounds.importance(p);
+    double second = nodes[nodes[current].offset].bounds.importance(p);
+    if (first <= 0.0 && second <= 0.0) return 0.0;
+
+    if (trail & 1) {
+      probability *= second / (first + second);
+      current = nodes[current].offset;
+    } else {
+      probability *= first / (first + second);
+      current = current + 1;
+    }
+    trail >>= 1;
+  }
+
+  if (nodes[current].bounds.importance(p) <= 0.0) return 0.0;
+  return probability;
+}
+
+double LightBVH::pdf(const glm::dvec3& p, const glm::dvec3& direction, const Hittable* light) const {
+  double light_pmf = pmf(p, light);
+  if (light_pmf <= 0.0) return 0.0;
+  return light_pmf * light->pdf_value(p, direction);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "AABB.hpp"
+#include "Hittable.hpp"
+
+// Conservative bounds on where a group of emitters is and in which directions it emits, as in
+// "Importance Sampling of Many Lights on the GPU" (Conty Estevez & Kulla 2018) and PBRT v4.
+// Used to estimate how much a whole cluster of lights can contribute to a receiving point.
+struct LightBounds {
+  AABB bounds;                        ///< Spatial bounds of the emitters
+  glm::dvec3 w = glm::dvec3(0, 0, 1); ///< Principal emission direction
+  double phi = 0.0;                   ///< Total emitted power
+  double cos_theta_o = 1.0;           ///< Cone of the emitters' normals around w
+  double cos_theta_e = 0.0;           ///< Emission spread around each normal, cos(pi/2) for diffuse emitters
+  bool two_sided = false;             ///< Emits on both sides of its normals
+
+  // Estimated contribution of the emitters to a receiver at p, 0 if they can't light it.
+  double importance(const glm::dvec3& p) const;
+
+  static LightBounds merge(const LightBounds& a, const LightBounds& b);
+};
+
+// Bounding volume hierarchy over the emitters of a scene, used to pick one light for next event
+// estimation in O(log N) with a probability proportional to its estimated contribution (power,
+// distance and orientation) at the shading point.
+//
+// Emitters are collected from the scene itself through Hittable::collect_emitters(): every object
+// whose material emits light registers, so scenes no longer keep a hand-made lights list. Triangle
+// meshes can't be sampled and are only found by BSDF sampling.
+class LightBVH {
+public:
+  explicit LightBVH(const Hittable& world);
+
+  bool empty() const { return lights.empty(); }
+  size_t size() const { return lights.size(); }
+
+  // Picks a light for a receiver at p and stores the probability of that choice in pmf.
+  // Returns nullptr if no light can contribute.
+  const Hittable* sample(const glm::dvec3& p, double& pmf) const;
+
+  // Probability that sample(p) picks light, 0 for objects that are not in the BVH.
+  double pmf(const glm::dvec3& p, const Hittable* light) const;
+
+  // Solid angle density of sample() followed by light->random(p) generating direction.
+  double pdf(const glm::dvec3& p, const glm::dvec3& direction, const Hittable* light) const;
+
+private:
+  struct Node {
+    LightBounds bounds;
+    uint32_t offset; // Index of the second child for interior nodes, of the light for leaves
+    bool leaf;
+  };
+
+  using Item = std::pair<const Hittable*, LightBounds>;
+
+  std::vector<const Hittable*> lights;
+  std::vector<Node> nodes; // Depth first, the first child of an interior node follows it
+  std::unordered_map<const Hittable*, uint64_t> trails; // Root-to-leaf path of each light, bit n is the choice at depth n
+
+  uint32_t build(std::vector<Item>& items, size_t start, size_t end, uint64_t trail, int depth);
+};
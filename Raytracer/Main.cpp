@@ -17,6 +17,9 @@ switch (0) {
   case 12: prob_dens_func_test(); break;
   case 13: dipole_diffusion_profile_test(); break; // actually random walk
   case 14: sss_gallery(); break;
+  case 15: compressed_mesh_test(false); break;
+  case 16: compressed_mesh_test(true); break; // out-of-core
+  case 17: sky_spheres(); break;
   //default: boosted_scene(800, 5000, 50); break;
   default: boosted_scene(800, 10000, 400); break;
   }
@@ -8,13 +8,21 @@
 
 #include <glm/glm.hpp>
 #include <memory>
+#include <variant>
 
 class ScatterRecord {
 public:
   glm::vec3 attenuation;
-  std::shared_ptr<PDF> pdf_ptr;
+  std::variant<std::monostate, CosinePDF, SpherePDF> pdf; ///< Sampling distribution, stored inline so scattering never allocates
   bool skip_pdf;
   Ray skip_pdf_ray;
+
+  // The active sampling distribution, or nullptr if the material doesn't use one.
+  const PDF* pdf_ptr() const {
+    if (const CosinePDF* cosine = std::get_if<CosinePDF>(&pdf)) return cosine;
+    if (const SpherePDF* sphere = std::get_if<SpherePDF>(&pdf)) return sphere;
+    return nullptr;
+  }
 };
 
 class Material {
@@ -27,6 +35,13 @@ public:
     virtual double scattering_pdf(const Ray& /*r_in*/, const HitRecord& /*rec*/, const Ray& /*scattered*/) const {
       return 0.0; // Default implementation returns 0, meaning no PDF is defined
     }
+
+    // Representative emitted radiance, used to weight lights by power. Zero for non-emitters.
+    virtual glm::vec3 average_emission() const { return glm::vec3(0.f); }
+
+    // Color of the surface at the hit, in [0, 1], recorded for the denoiser. Materials that don't
+    // override it count as white.
+    virtual glm::vec3 surface_albedo(const HitRecord& /*rec*/) const { return glm::vec3(1.f); }
     
 };
 
@@ -36,11 +51,8 @@ public:
   Lambertian(std::shared_ptr<ITexture>texture) : texture(texture) {}
 
   bool scatter(const Ray& /*in*/, const HitRecord& rec, ScatterRecord& scatter_rec) const override {
-    OrthoNormalBasis basis(rec.normal);
-    glm::dvec3 scatter_direction = basis.transform(random_cosine_direction());
-
     scatter_rec.attenuation = texture->color_value(rec.u, rec.v, rec.p);
-    scatter_rec.pdf_ptr = std::make_shared<CosinePDF>(rec.normal);
+    scatter_rec.pdf = CosinePDF(rec.normal);
     scatter_rec.skip_pdf = false;
     return true;
   }
@@ -50,6 +62,10 @@ public:
     return (cos_theta  < 0) ? 0 : cos_theta / pi; // PDF for Lambertian scattering
   }
 
+  glm::vec3 surface_albedo(const HitRecord& rec) const override {
+    return texture->color_value(rec.u, rec.v, rec.p);
+  }
+
 private:
   std::shared_ptr<ITexture> texture;
 };
@@ -63,12 +79,15 @@ class Metal : public Material {
       reflected = glm::normalize(reflected) + (fuzz * random_unit_vector()); // Normalize the reflected direction
 
       scatter_rec.attenuation = albedo;
-      scatter_rec.pdf_ptr = nullptr; // Metal does not use a PDF for scattering
+      scatter_rec.pdf = std::monostate{}; // Metal does not use a PDF for scattering
       scatter_rec.skip_pdf = true; // Metal does not use a PDF for scattering
       scatter_rec.skip_pdf_ray = Ray(rec.p, reflected, in.time()); // Store the scattered ray
 
       return true;
     }
+
+    glm::vec3 surface_albedo(const HitRecord& /*rec*/) const override { return albedo; }
+
   private:
     glm::vec3 albedo;
     double fuzz; // Fuzziness factor for the metal surface
@@ -80,7 +99,7 @@ class Dielectric : public Material {
 
     bool scatter(const Ray& in, const HitRecord& rec, ScatterRecord& scatter_rec) const override {
       scatter_rec.attenuation = glm::vec3(1.0, 1.0, 1.0); // Light is not absorbed
-      scatter_rec.pdf_ptr = nullptr; // Dielectric does not use a PDF for scattering
+      scatter_rec.pdf = std::monostate{}; // Dielectric does not use a PDF for scattering
       scatter_rec.skip_pdf = true; // Dielectric does not use a PDF for scattering
 
       double etai_over_etat = rec.front_face ? (1.0 / ref_idx) : ref_idx; // Determine the index of refraction
@@ -121,6 +140,17 @@ class DiffuseLight : public Material {
       return texture->color_value(u, v, point);
     }
 
+    glm::vec3 average_emission() const override {
+      return texture->color_value(0.5, 0.5, glm::dvec3(0.0));
+    }
+
+    glm::vec3 surface_albedo(const HitRecord& rec) const override {
+      // The hue of the emission, scaled into [0, 1].
+      glm::vec3 color = texture->color_value(rec.u, rec.v, rec.p);
+      float peak = glm::max(color.x, glm::max(color.y, color.z));
+      return peak > 0.f ? color / peak : glm::vec3(0.f);
+    }
+
   private:
     std::shared_ptr<ITexture> texture; // Texture for the emitted light color
 };
@@ -132,7 +162,7 @@ public:
 
   bool scatter(const Ray& /*r_in*/, const HitRecord& rec, ScatterRecord& scatter_rec) const override {
     scatter_rec.attenuation = tex->color_value(rec.u, rec.v, rec.p);
-    scatter_rec.pdf_ptr = std::make_shared<SpherePDF>();
+    scatter_rec.pdf = SpherePDF();
     scatter_rec.skip_pdf = false;
     return true;
   }
@@ -141,6 +171,10 @@ public:
     return 1.0 / (4 * pi); // Uniform isotropic scattering PDF
   }
 
+  glm::vec3 surface_albedo(const HitRecord& rec) const override {
+    return tex->color_value(rec.u, rec.v, rec.p);
+  }
+
 private:
   std::shared_ptr<ITexture> tex;
 };
@@ -168,7 +202,7 @@ public:
     double Fr = R0 + (1 - R0) * std::pow(1 - cos_i, 5);
     Fr *= 0.08;                                   // damp shiny look
 
-    if (rnd() < Fr) {                             // reflect
+    if (random_double() < Fr) {                             // reflect
       glm::dvec3 refl = glm::reflect(wo, n);
       srec.skip_pdf_ray = Ray(rec.p, refl);
       srec.skip_pdf = true;
@@ -188,11 +222,11 @@ public:
     for (int bounce = 0; bounce < 512; ++bounce) {
       glm::dvec3 sigma_t = sigma_s + sigma_a;
       double sum_sigma = sigma_t.x + sigma_t.y + sigma_t.z;
-      double xi = rnd() * sum_sigma;
+      double xi = random_double() * sum_sigma;
       int    ch = (xi < sigma_t.x) ? 0 : (xi < sigma_t.x + sigma_t.y ? 1 : 2);
       double sigma_t_ch = (ch == 0 ? sigma_t.x : (ch == 1 ? sigma_t.y : sigma_t.z));
 
-      double t = -std::log(1 - rnd()) / sigma_t_ch;
+      double t = -std::log(1 - random_double()) / sigma_t_ch;
       pos += dir * t;
 
       /* exit test for arbitrary shape */
@@ -200,7 +234,8 @@ public:
         // push the point slightly back to the boundary normal
         Ray exit_ray(pos, glm::normalize(pos - rec.p)); // crude normal
         HitRecord exit_rec;
-        shape->hit(exit_ray, Interval(1e-4, infinity), exit_rec);
+        if (shape->hit(exit_ray, Interval(1e-4, infinity), exit_rec))
+          exit_rec.prim->surface_interaction(exit_ray, exit_rec);
 
         glm::dvec3 out = sample_hg(g, exit_rec.normal);
         srec.skip_pdf_ray = Ray(pos, out);
@@ -216,7 +251,7 @@ public:
       /* Russian roulette */
       if (bounce > 8) {
         double q = std::max({ Tr.x,Tr.y,Tr.z });
-        if (rnd() > q) return false;
+        if (random_double() > q) return false;
         Tr /= q;
       }
       /* new direction */
@@ -225,10 +260,15 @@ public:
     return false; // path exceeded bounce budget
   }
 
+  glm::vec3 surface_albedo(const HitRecord& /*rec*/) const override {
+    return glm::vec3(sigma_s / glm::max(sigma_s + sigma_a, glm::dvec3(1e-12))); // Single scattering albedo
+  }
+
 private:
   // Henyey–Greenstein Phase Function -------------------------------------------
   glm::dvec3 sample_hg(double hg, glm::dvec3& wo) const {
-    double xi = rnd();
+    glm::dvec2 r = random_double_2d();
+    double xi = r.x;
     double cos_theta;
     if (std::abs(hg) < 1e-3) cos_theta = 1 - 2 * xi;
     else {
@@ -236,7 +276,7 @@ private:
       cos_theta = (1 + hg * hg - sq * sq) / (2 * hg);
     }
     double sin_theta = std::sqrt(std::max(0.0, 1 - cos_theta * cos_theta));
-    double phi = 2 * pi * rnd();
+    double phi = 2 * pi * r.y;
 
     // build local frame around wo
     glm::dvec3 w = glm::normalize(wo);
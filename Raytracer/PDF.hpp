@@ -63,11 +63,12 @@ private:
   glm::dvec3 origin;
 };
 
+// Non-owning: both PDFs must outlive the mixture, which is meant to be built on the stack.
 class MixturePDF: public PDF {
 public:
-  MixturePDF(std::shared_ptr<PDF> p0, std::shared_ptr<PDF> p1) {
-    p[0] = p0;
-    p[1] = p1;
+  MixturePDF(const PDF& p0, const PDF& p1) {
+    p[0] = &p0;
+    p[1] = &p1;
   }
 
   double value(const glm::dvec3& direction) const override {
@@ -82,5 +83,5 @@ public:
   }
 
 private:
-  std::shared_ptr<PDF> p[2];
+  const PDF* p[2];
 };
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "RayPacket.hpp"
+#include "Constants.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+RayPacket::RayPacket(std::span<const Ray> packet_rays)
+  : count(int(std::min<size_t>(packet_rays.size(), max_size)))
+{
+  coherent = count > 0;
+  for (int i = 0; i < count; ++i) {
+    const Ray& r = packet_rays[i];
+    rays[i] = r;
+    t_max[i] = infinity;
+
+    const glm::dvec3& o = r.origin();
+    const glm::dvec3& d = r.direction();
+    origin_x[i] = o.x;
+    origin_y[i] = o.y;
+    origin_z[i] = o.z;
+    inv_x[i] = 1.0 / d.x;
+    inv_y[i] = 1.0 / d.y;
+    inv_z[i] = 1.0 / d.z;
+
+    glm::dvec3 inv(inv_x[i], inv_y[i], inv_z[i]);
+    glm::dvec3 s(d.x < 0.0 ? -1.0 : 1.0, d.y < 0.0 ? -1.0 : 1.0, d.z < 0.0 ? -1.0 : 1.0);
+    if (i == 0) {
+      signs = s;
+      origin_min = origin_max = o;
+      inv_min = inv_max = inv;
+    } else {
+      coherent = coherent && s == signs;
+      origin_min = glm::min(origin_min, o);
+      origin_max = glm::max(origin_max, o);
+      inv_min = glm::min(inv_min, inv);
+      inv_max = glm::max(inv_max, inv);
+    }
+    coherent = coherent && d.x != 0.0 && d.y != 0.0 && d.z != 0.0;
+  }
+  coherent = coherent && std::isfinite(inv_min.x + inv_min.y + inv_min.z + inv_max.x + inv_max.y + inv_max.z);
+}
+
+namespace {
+  // Smallest and largest product of a value in [a0, a1] and one in [b0, b1].
+  double product_min(double a0, double a1, double b0, double b1) {
+    return std::min(std::min(a0 * b0, a0 * b1), std::min(a1 * b0, a1 * b1));
+  }
+
+  double product_max(double a0, double a1, double b0, double b1) {
+    return std::max(std::max(a0 * b0, a0 * b1), std::max(a1 * b0, a1 * b1));
+  }
+}
+
+bool RayPacket::frustum_hit(const AABB& box, Interval t) const {
+  if (!coherent) return true;
+
+  // Every ray enters the box no sooner than the earliest entry over the packet's origin and
+  // direction ranges, and leaves it no later than the latest exit. If the latest entry plane is
+  // reached after the earliest exit plane, no ray of the packet can be inside the box.
+  double enter = t.min;
+  double exit = t.max;
+  for (int axis = 0; axis < 3; ++axis) {
+    const Interval& slab = box.axis_interval(axis);
+    double near_plane = signs[axis] > 0.0 ? slab.min : slab.max;
+    double far_plane = signs[axis] > 0.0 ? slab.max : slab.min;
+
+    enter = std::max(enter, product_min(near_plane - origin_max[axis], near_plane - origin_min[axis], inv_min[axis], inv_max[axis]));
+    exit = std::min(exit, product_max(far_plane - origin_max[axis], far_plane - origin_min[axis], inv_min[axis], inv_max[axis]));
+  }
+  return enter <= exit;
+}
+
+uint64_t RayPacket::hit_mask(const AABB& box, Interval t, uint64_t active) const {
+  // Same slab test as AABB::hit(), for every lane at once. No early outs, so this compiles to
+  // straight SIMD code; inactive lanes are tested too and masked out afterwards.
+  const double x0 = box.x.min, x1 = box.x.max;
+  const double y0 = box.y.min, y1 = box.y.max;
+  const double z0 = box.z.min, z1 = box.z.max;
+
+  alignas(64) uint8_t inside[max_size];
+  for (int i = 0; i < count; ++i) {
+    double tx0 = (x0 - origin_x[i]) * inv_x[i];
+    double tx1 = (x1 - origin_x[i]) * inv_x[i];
+    double ty0 = (y0 - origin_y[i]) * inv_y[i];
+    double ty1 = (y1 - origin_y[i]) * inv_y[i];
+    double tz0 = (z0 - origin_z[i]) * inv_z[i];
+    double tz1 = (z1 - origin_z[i]) * inv_z[i];
+
+    double t_near = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), t.min));
+    double t_far = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), t_max[i]));
+    inside[i] = t_near < t_far;
+  }
+
+  uint64_t mask = 0;
+  for (int i = 0; i < count; ++i)
+    mask |= uint64_t(inside[i]) << i;
+  return mask & active;
+}
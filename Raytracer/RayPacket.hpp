@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <glm/glm.hpp>
+
+#include "AABB.hpp"
+#include "Interval.hpp"
+#include "Ray.hpp"
+
+// Up to 64 coherent rays, typically the camera rays of an 8x8 pixel tile, traced together through
+// Hittable::hit_packet(). Origins, inverse directions and closest hit distances are stored as one
+// array per component so the per-lane slab test runs as a branch free loop the compiler can
+// vectorize. Lanes are addressed by bit masks, bit i set meaning lane i is still active.
+//
+// When the direction of every ray has the same sign on every axis, the packet also keeps interval
+// bounds on its origins and inverse directions: a conservative frustum that rejects a box for all
+// lanes with a single test (interval arithmetic culling, as in Wald et al. 2007 "Ray Tracing
+// Deformable Scenes Using Dynamic Bounding Volume Hierarchies"). Unlike corner ray planes this
+// stays valid for the differing origins of defocused cameras.
+class RayPacket {
+public:
+  static constexpr int max_size = 64;
+
+  explicit RayPacket(std::span<const Ray> rays);
+
+  int size() const { return count; }
+  uint64_t all() const { return count == max_size ? ~uint64_t(0) : (uint64_t(1) << count) - 1; }
+  const Ray& ray(int lane) const { return rays[lane]; }
+
+  // False if no ray of the packet can hit box within t, only valid for coherent packets.
+  bool frustum_hit(const AABB& box, Interval t) const;
+
+  // Lanes of active whose ray hits box between t.min and its current closest hit.
+  uint64_t hit_mask(const AABB& box, Interval t, uint64_t active) const;
+
+  // Shared sign of the direction components, +1 or -1, meaningless when !coherent.
+  const glm::dvec3& direction_signs() const { return signs; }
+
+  double t_max[max_size]; ///< Closest hit distance found so far per lane, clips further tests
+
+private:
+  int count;
+  Ray rays[max_size];
+  double origin_x[max_size], origin_y[max_size], origin_z[max_size];
+  double inv_x[max_size], inv_y[max_size], inv_z[max_size];
+
+  bool coherent;                           ///< Direction signs agree per axis and no direction is axis parallel
+  glm::dvec3 signs;                        ///< Sign of the directions per axis
+  glm::dvec3 origin_min, origin_max;       ///< Bounds of the origins
+  glm::dvec3 inv_min, inv_max;             ///< Bounds of the inverse directions
+};
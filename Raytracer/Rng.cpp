@@ -0,0 +1,15 @@
+#include "Rng.hpp"
+
+namespace {
+  uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  }
+}
+
+void Rng::reseed(uint64_t seed) {
+  for (uint64_t& word : s)
+    word = splitmix64(seed);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <omp.h>
+
+// xoshiro256+ ("Scrambled Linear Pseudorandom Number Generators", Blackman & Vigna 2021): 256 bits
+// of state, a handful of shifts and xors per number and no shared state, so every thread owns its
+// own generator (thread_rng()) and never waits on a lock the way the C library rand() does.
+// The low bits of xoshiro256+ are weak; doubles are built from the top bits only.
+class Rng {
+public:
+  explicit Rng(uint64_t seed = 0) { reseed(seed); }
+
+  // Expands seed into the full state with splitmix64, as the authors recommend.
+  void reseed(uint64_t seed);
+
+  uint64_t next() {
+    const uint64_t result = s[0] + s[3];
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return result;
+  }
+
+  // Uniform double in [0, 1) from the top 53 bits.
+  double uniform() { return (next() >> 11) * 0x1p-53; }
+
+private:
+  uint64_t s[4];
+};
+
+// Counter based generation: a uniform double in [0, 1) that is a pure function of key and counter,
+// so values can be drawn in any order, on any thread. Two rounds of the splitmix64 finalizer.
+inline double counter_uniform(uint64_t key, uint64_t counter) {
+  auto mix = [](uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+  };
+  return (mix(key ^ mix(counter + 0x9e3779b97f4a7c15)) >> 11) * 0x1p-53;
+}
+
+// Generator of the calling thread, seeded from the thread's OpenMP number.
+inline Rng& thread_rng() {
+  thread_local Rng rng(2025 +
+#ifdef _OPENMP
+    omp_get_thread_num()
+#else
+    0
+#endif
+  );
+  return rng;
+}
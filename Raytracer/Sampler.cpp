@@ -0,0 +1,113 @@
+#include "Sampler.hpp"
+#include "Rng.hpp"
+
+#include <vector>
+
+namespace {
+  uint32_t reverse_bits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+    x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+    x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+    x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+    return x;
+  }
+
+  uint32_t mix_bits(uint32_t x) {
+    // 32 bit integer finalizer ("lowbias32", Wellons).
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+  }
+
+  uint32_t hash(uint32_t a, uint32_t b) {
+    return mix_bits(a ^ mix_bits(b + 0x9e3779b9));
+  }
+
+  uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+    // Every bit only depends on itself and the bits below it.
+    x += seed;
+    x ^= x * 0x6c50b47c;
+    x ^= x * 0xb82f1e52;
+    x ^= x * 0xc7afe638;
+    x ^= x * 0x8d22f6e6;
+    return x;
+  }
+
+  uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+    // Owen scrambling of a 0.32 fixed point value: each bit is flipped depending on the bits above it.
+    return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+  }
+
+  uint32_t sobol_dimension_1(uint32_t index) {
+    // Second Sobol dimension (primitive polynomial x + 1), the first one is reverse_bits(index).
+    uint32_t x = 0;
+    for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+      if (index & 1) x ^= v;
+    return x;
+  }
+
+  double to_unit(uint32_t x) {
+    return x * 0x1p-32;
+  }
+
+  struct Point2 {
+    uint32_t x, y;
+  };
+
+  const std::vector<Point2>& pmj02_table() {
+    // Any scrambled (0,2) sequence is progressively multi-jittered: every power of two prefix is
+    // stratified over all the elementary intervals, including the 1D projections and the square
+    // grid. The table is one such sequence, Owen scrambled with fixed seeds.
+    static const std::vector<Point2> table = [] {
+      std::vector<Point2> points(PMJ02Sampler::table_size);
+      for (uint32_t i = 0; i < PMJ02Sampler::table_size; ++i) {
+        points[i].x = nested_uniform_scramble(reverse_bits(i), 0x8a3f71c5);
+        points[i].y = nested_uniform_scramble(sobol_dimension_1(i), 0x2c6e94b1);
+      }
+      return points;
+    }();
+    return table;
+  }
+}
+
+std::unique_ptr<Sampler> make_sampler(SamplerType type, uint32_t seed) {
+  switch (type) {
+  case SamplerType::sobol:
+    return std::make_unique<SobolSampler>(seed);
+  case SamplerType::pmj02:
+    return std::make_unique<PMJ02Sampler>(seed);
+  default:
+    return std::make_unique<IndependentSampler>(seed);
+  }
+}
+
+double IndependentSampler::sample(uint32_t dimension) {
+  return counter_uniform((uint64_t(current_pixel) << 32) | current_sample, (uint64_t(seed) << 32) | dimension);
+}
+
+double SobolSampler::sample(uint32_t dimension) {
+  // Both dimensions of a pair shuffle the indices the same way, so they read matching Sobol points.
+  uint32_t scramble = hash(hash(seed, current_pixel), dimension >> 1);
+  uint32_t index = nested_uniform_scramble(current_sample, scramble);
+  uint32_t x = (dimension & 1) ? sobol_dimension_1(index) : reverse_bits(index);
+  return to_unit(nested_uniform_scramble(x, hash(scramble, dimension & 1)));
+}
+
+double PMJ02Sampler::sample(uint32_t dimension) {
+  // The shuffle maps the first 2^k samples of the pixel to an aligned block of 2^k table entries,
+  // itself stratified like a prefix. The xor (random digit scramble) keeps the stratification.
+  // Past the table, every further block of table_size samples is its own randomization of the
+  // table (shuffle and xor), otherwise it would replay the first block's points and a pixel could
+  // never converge beyond a table_size point estimate.
+  static const std::vector<Point2>& table = pmj02_table();
+  uint32_t scramble = hash(hash(seed, current_pixel), dimension >> 1);
+  if (const uint32_t block = current_sample / table_size)
+    scramble = hash(scramble, block);
+  const Point2& point = table[nested_uniform_scramble(current_sample, scramble) & (table_size - 1)];
+  uint32_t x = (dimension & 1) ? point.y : point.x;
+  return to_unit(x ^ hash(scramble, 2 + (dimension & 1)));
+}
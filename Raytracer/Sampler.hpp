@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <glm/glm.hpp>
+
+// Source of the random numbers consumed by one pixel sample. A path draws its dimensions one after
+// the other through random_double(): the camera ray takes the first camera_dimensions (pixel
+// position, lens, time), then every light pick, light sample, BSDF sample and random walk step
+// takes the next ones in the order the path reaches them.
+//
+// Low discrepancy samplers stratify each dimension over the samples of a pixel, and consecutive
+// dimension pairs (2k, 2k + 1) jointly. 2D samples (a direction, a point on a light) are drawn with
+// get_2d(), which skips to the next even dimension so their two variates always land on a pair and
+// are stratified together, whatever 1D draws came before. Any sample count works, though the
+// stratification is best at powers of two.
+//
+// Every value is a function of (seed, pixel, sample index, dimension) alone, never of the thread
+// that draws it or of the order pixels are rendered in, so a render is reproducible bit for bit
+// with any thread count or schedule.
+enum class SamplerType {
+  independent, // Uniform random numbers, no stratification
+  sobol,       // Owen scrambled Sobol (0,2) sequence per dimension pair
+  pmj02,       // Progressive multi-jittered (0,2) table, scrambled per pixel
+};
+
+class Sampler {
+public:
+  static constexpr uint32_t camera_dimensions = 6;         // Reserved for the camera ray, paths start after them
+  static constexpr uint32_t traversal_dimensions = 1u << 31; // Numbers drawn while intersecting batches of rays, clear of any path
+
+  explicit Sampler(uint32_t seed = 0) : seed(seed) {}
+  virtual ~Sampler() = default;
+
+  // Moves to dimension of sample sample_index of pixel.
+  void start_pixel_sample(uint32_t pixel, uint32_t sample_index, uint32_t dimension = 0) {
+    current_pixel = pixel;
+    current_sample = sample_index;
+    next_dimension = dimension;
+  }
+
+  uint32_t dimension() const { return next_dimension; }
+  double get_1d() { return sample(next_dimension++); }
+
+  // Both variates of a dimension pair, rounding the next dimension up to an even one first.
+  glm::dvec2 get_2d() {
+    next_dimension += next_dimension & 1;
+    glm::dvec2 u(sample(next_dimension), sample(next_dimension + 1));
+    next_dimension += 2;
+    return u;
+  }
+
+  // The sampler random_double() draws from on this thread, see SamplerScope.
+  inline static thread_local Sampler* active = nullptr;
+
+protected:
+  // Value in [0, 1) of dimension of the current pixel sample.
+  virtual double sample(uint32_t dimension) = 0;
+
+  uint32_t seed;
+  uint32_t current_pixel = 0;
+  uint32_t current_sample = 0;
+
+private:
+  uint32_t next_dimension = 0;
+};
+
+std::unique_ptr<Sampler> make_sampler(SamplerType type, uint32_t seed = 0);
+
+// Makes sampler the one random_double() draws from on this thread for the lifetime of the scope.
+class SamplerScope {
+public:
+  explicit SamplerScope(Sampler& sampler) : previous(Sampler::active) { Sampler::active = &sampler; }
+  ~SamplerScope() { Sampler::active = previous; }
+
+  SamplerScope(const SamplerScope&) = delete;
+  SamplerScope& operator=(const SamplerScope&) = delete;
+
+private:
+  Sampler* previous;
+};
+
+// Counter based: each value hashes its seed, pixel, sample index and dimension (counter_uniform()).
+class IndependentSampler : public Sampler {
+public:
+  using Sampler::Sampler;
+
+protected:
+  double sample(uint32_t dimension) override;
+};
+
+// "Practical Hash-based Owen Scrambling" (Burley 2020). Every dimension pair shuffles the sample
+// indices of the pixel with a nested uniform scramble and reads the first two Sobol dimensions,
+// each Owen scrambled with its own seed. Needs no tables and stays a (0,2) sequence per pair.
+class SobolSampler : public Sampler {
+public:
+  using Sampler::Sampler;
+
+protected:
+  double sample(uint32_t dimension) override;
+};
+
+// Progressive multi-jittered (0,2) points ("Progressive Multi-Jittered Sample Sequences",
+// Christensen, Kensler & Kilpatrick 2018), read from a shared table as PBRT v4 does: every pixel
+// and dimension pair shuffles the table indices and flips a random set of coordinate bits, which
+// keeps the stratification of the table. The table is built once from a scrambled (0,2) sequence
+// rather than with the paper's rejection construction; a lookup and a xor per dimension make it
+// cheaper than SobolSampler. Pixels taking more than table_size samples get a fresh randomization
+// of the table for every block of table_size, so they keep converging, stratified within each block.
+class PMJ02Sampler : public Sampler {
+public:
+  using Sampler::Sampler;
+
+  static constexpr uint32_t table_size = 1u << 16;
+
+protected:
+  double sample(uint32_t dimension) override;
+};
@@ -60,10 +60,6 @@ void bouncing_spheres() {
   // Quad Light
   std::shared_ptr<DiffuseLight> light = std::make_shared<DiffuseLight>(glm::vec3(4, 4, 4));
   world.add(std::make_shared<Quad>(glm::dvec3(0, 10, 0), glm::dvec3(1, 0, 0), glm::dvec3(0, 0, 1), light));
-  // Light Sources
-  std::shared_ptr<Material> empty_material = std::shared_ptr<Material>();
-  HitPool lights;
-  lights.add(std::make_shared<Quad>(glm::dvec3(0, 10, 0), glm::dvec3(1, 0, 0), glm::dvec3(0, 0, 1), empty_material));
 
   world = HitPool(std::make_shared<BVHNode>(world)); // Create a BVH from the hit pool for efficient ray tracing
 
@@ -83,7 +79,7 @@ void bouncing_spheres() {
   cam.defocus_angle = 0.1;
   cam.focus_distance = 10.0;
 
-  cam.render(world, lights);
+  cam.render(world);
 }
 
 void checkered_spheres() {
@@ -96,10 +92,6 @@ void checkered_spheres() {
   // Quad Light
   std::shared_ptr<DiffuseLight> light = std::make_shared<DiffuseLight>(glm::vec3(4, 4, 4));
   world.add(std::make_shared<Quad>(glm::dvec3(0, 5, 0), glm::dvec3(1, 0, 0), glm::dvec3(0, 0, 1), light));
-  // Light Sources
-  std::shared_ptr<Material> empty_material = std::shared_ptr<Material>();
-  HitPool lights;
-  lights.add(std::make_shared<Quad>(glm::dvec3(0, 5, 0), glm::dvec3(1, 0, 0), glm::dvec3(0, 0, 1), empty_material));
 
   // Camera
   Camera cam;
@@ -116,7 +108,7 @@ void checkered_spheres() {
 
   cam.defocus_angle = 0.0;
   
-  cam.render(world, lights);
+  cam.render(world);
 }
 
 void earth() {
@@ -130,10 +122,6 @@ void earth() {
   // Quad Light
   std::shared_ptr<DiffuseLight> light = std::make_shared<DiffuseLight>(glm::vec3(4, 4, 4));
   world.add(std::make_shared<Quad>(glm::dvec3(0, 5, 0), glm::dvec3(1, 0, 0), glm::dvec3(0, 0, 1), light));
-  // Light Sources
-  std::shared_ptr<Material> empty_material = std::shared_ptr<Material>();
-  HitPool lights;
-  lights.add(std::make_shared<Quad>(glm::dvec3(0, 5, 0), glm::dvec3(1, 0, 0), glm::dvec3(0, 0, 1), empty_material));
 
   // Camera
   Camera cam;
@@ -150,7 +138,7 @@ void earth() {
 
   cam.defocus_angle = 0.0;
 
-  cam.render(world, lights);
+  cam.render(world);
 }
 
 void perlin_spheres() {
@@ -163,10 +151,6 @@ void perlin_spheres() {
   // Quad Light
   std::shared_ptr<DiffuseLight> light = std::make_shared<DiffuseLight>(glm::vec3(4, 4, 4));
   world.add(std::make_shared<Quad>(glm::dvec3(0, 5, 0), glm::dvec3(1, 0, 0), glm::dvec3(0, 0, 1), light));
-  // Light Sources
-  std::shared_ptr<Material> empty_material = std::shared_ptr<Material>();
-  HitPool lights;
-  lights.add(std::make_shared<Quad>(glm::dvec3(0, 5, 0), glm::dvec3(1, 0, 0), glm::dvec3(0, 0, 1), empty_material));
 
   Camera cam;
 
@@ -183,7 +167,7 @@ void perlin_spheres() {
 
   cam.defocus_angle = 0;
 
-  cam.render(world, lights);
+  cam.render(world);
 }
 
 void quads() {
@@ -217,10 +201,6 @@ void quads() {
   // Quad Light
   std::shared_ptr<DiffuseLight> light = std::make_shared<DiffuseLight>(glm::vec3(4, 4, 4));
   world.add(std::make_shared<Quad>(glm::dvec3(-1, 0, -1), glm::dvec3(1, 0, 0), glm::dvec3(0, 0, 1), light));
-  // Light Sources
-  std::shared_ptr<Material> empty_material = std::shared_ptr<Material>();
-  HitPool lights;
-  lights.add(std::make_shared<Quad>(glm::dvec3(-1, 0, -1), glm::dvec3(1, 0, 0), glm::dvec3(0, 0, 1), empty_material));
 
   Camera cam;
 
@@ -237,7 +217,7 @@ void quads() {
 
   cam.defocus_angle = 0;
 
-  cam.render(world, lights);
+  cam.render(world);
 }
 
 void simple_light() {
@@ -252,11 +232,6 @@ void simple_light() {
   std::shared_ptr<DiffuseLight> light = std::make_shared<DiffuseLight>(glm::vec3(4, 4, 4));  
   world.add(std::make_shared<Quad>(glm::dvec3(3, 1, -2), glm::dvec3(2, 0, 0), glm::dvec3(0, 2, 0), light));
 
-  // Light Sources
-  std::shared_ptr<Material> empty_material = std::shared_ptr<Material>();
-  HitPool lights;
-  lights.add(std::make_shared<Quad>(glm::dvec3(3, 1, -2), glm::dvec3(2, 0, 0), glm::dvec3(0, 2, 0), empty_material));
-
   Camera cam;
 
   cam.aspect_ratio = 16.0 / 9.0;
@@ -272,7 +247,7 @@ void simple_light() {
 
   cam.defocus_angle = 0;
 
-  cam.render(world, lights);
+  cam.render(world);
 }
 
 void cornell_box() {
@@ -310,12 +285,6 @@ void cornell_box() {
   std::shared_ptr<Dielectric> glass = std::make_shared<Dielectric>(1.5);
   world.add(std::make_shared<Sphere>(glm::dvec3(190, 90, 190), 90, glass));
 
-  // Light Sources
-  std::shared_ptr<Material> empty_material = std::shared_ptr<Material>();
-  HitPool lights;
-  lights.add(std::make_shared<Quad>(glm::dvec3(343, 554, 332), glm::dvec3(-130, 0, 0), glm::dvec3(0, 0, -105), empty_material));
-  lights.add(std::make_shared<Sphere>(glm::dvec3(190,90,190), 90, empty_material));
-
   Camera cam;
 
   cam.aspect_ratio = 1;
@@ -331,7 +300,7 @@ void cornell_box() {
 
   cam.defocus_angle = 0;
 
-  cam.render(world, lights);
+  cam.render(world);
 }
 
 void cornell_smoke() {
@@ -364,11 +333,6 @@ void cornell_smoke() {
   world.add(std::make_shared<ConstantMedium>(box1, 0.01, glm::vec3(0.0)));
   world.add(std::make_shared<ConstantMedium>(box2, 0.01, glm::vec3(1.0)));
 
-  // Light Sources
-  std::shared_ptr<Material> empty_material = std::shared_ptr<Material>();
-  HitPool lights;
-  lights.add(std::make_shared<Quad>(glm::dvec3(343, 554, 332), glm::dvec3(-130, 0, 0), glm::dvec3(0, 0, -105), empty_material));
-
   Camera cam;
 
   cam.aspect_ratio = 16.0 / 9.0;
@@ -384,7 +348,7 @@ void cornell_smoke() {
 
   cam.defocus_angle = 0;
 
-  cam.render(world, lights);
+  cam.render(world);
 }
 
 void final_scene(int image_width, int samples_per_pixel, int max_depth) {
@@ -413,11 +377,6 @@ void final_scene(int image_width, int samples_per_pixel, int max_depth) {
   auto light = std::make_shared<DiffuseLight>(glm::vec3(7, 7, 7));
   world.add(std::make_shared<Quad>(glm::dvec3(123, 554, 147), glm::dvec3(300, 0, 0), glm::dvec3(0, 0, 265), light));
 
-  // Light Sources
-  std::shared_ptr<Material> empty_material = std::shared_ptr<Material>();
-  HitPool lights;
-  lights.add(std::make_shared<Quad>(glm::dvec3(123, 554, 147), glm::dvec3(300, 0, 0), glm::dvec3(0, 0, 265), empty_material));
-
   auto center1 = glm::dvec3(400, 400, 200);
   auto center2 = center1 + glm::dvec3(30, 0, 0);
   auto sphere_material = std::make_shared<Lambertian>(glm::vec3(0.7, 0.3, 0.1));
@@ -468,12 +427,11 @@ void final_scene(int image_width, int samples_per_pixel, int max_depth) {
 
   cam.defocus_angle = 0;
 
-  cam.render(world, lights);
+  cam.render(world);
 }
 
 void boosted_scene(int image_width, int samples_per_pixel, int max_depth) {
   HitPool world;
-  HitPool lights;
 
   // Ground using grid of boxes
   HitPool boxes1;
@@ -516,18 +474,14 @@ void boosted_scene(int image_width, int samples_per_pixel, int max_depth) {
   auto marble = std::make_shared<SubsurfaceMaterial>(glm::dvec3(2.19, 2.62, 3.0), glm::dvec3(0.0021, 0.0041, 0.0071), 0.0, 1.5); 
   auto skin = std::make_shared<SubsurfaceMaterial>(glm::dvec3(0.74, 0.88, 1.01), glm::dvec3(0.032, 0.17, 0.48), 0.9, 1.40);
 
-  auto empty_mat = std::shared_ptr<Material>();
-
   // Overhead light
   auto light = std::make_shared<DiffuseLight>(glm::vec3(7, 7, 7));
   auto pin_light = std::make_shared<DiffuseLight>(glm::vec3(15, 15, 15));
   auto ceiling_light = std::make_shared<Quad>(glm::dvec3(123, 554, 147), glm::dvec3(300, 0, 0), glm::dvec3(0, 0, 265), light);
   world.add(ceiling_light);
-  lights.add(std::make_shared<Quad>(glm::dvec3(123, 554, 147), glm::dvec3(300, 0, 0), glm::dvec3(0, 0, 265), empty_mat));
   // Back light to enhance sss qualities
   auto back_light = std::make_shared<Sphere>(glm::dvec3(450, 220, 0), 25, pin_light);
   world.add(back_light);
-  lights.add(std::make_shared<Sphere>(glm::dvec3(500, 150, 0), 25, empty_mat));
 
   // Add Scene shapes
   world.add(std::make_shared<Sphere>(glm::dvec3(400, 200, 400), 100, earth)); // Textured Earth sphere
@@ -589,7 +543,7 @@ void boosted_scene(int image_width, int samples_per_pixel, int max_depth) {
   cam.view_up = glm::dvec3(0, 1, 0);
   cam.defocus_angle = 0;
 
-  cam.render(world, lights);
+  cam.render(world);
 }
 
 void glass_pyr_test() {
@@ -617,11 +571,6 @@ void glass_pyr_test() {
     glm::dvec3(0, 0, 100),
     light)); // light object
 
-  // Light Sources
-  std::shared_ptr<Material> empty_material = std::shared_ptr<Material>();
-  HitPool lights;
-  lights.add(std::make_shared<Quad>( glm::dvec3(-50, 499, -300), glm::dvec3(100, 0, 0), glm::dvec3(0, 0, 100), empty_material));
-
   world.add(std::make_shared<Sphere>(glm::dvec3(50, 100, -250), 50, white));
   
   // very sneaky sneaky cheeky way to make a glass pyramid by adding a (hemi)sphere at the top, avoiding numerical issues with the pyramid planes
@@ -643,7 +592,6 @@ void glass_pyr_test() {
   double tip_radius = 2.5;
   world.add(std::make_shared<Sphere>(apex - glm::dvec3(0, tip_radius, 0), tip_radius, glass));
 
-
   Camera cam;
 
   cam.aspect_ratio = 16.0 / 9.0;
@@ -659,7 +607,7 @@ void glass_pyr_test() {
 
   cam.defocus_angle = 0;
 
-  cam.render(world, lights);
+  cam.render(world);
 }
 
 void prob_dens_func_test() {
@@ -682,10 +630,6 @@ void prob_dens_func_test() {
 
   //Light
   world.add(std::make_shared<Quad>(glm::dvec3(343, 554, 332), glm::dvec3(-130, 0, 0), glm::dvec3(0, 0, -105), light));
-    // Light Sources
-  std::shared_ptr<Material> empty_material = std::shared_ptr<Material>();
-  HitPool lights;
-  lights.add(std::make_shared<Quad>(glm::dvec3(343, 554, 332), glm::dvec3(-130, 0, 0), glm::dvec3(0, 0, -105), empty_material));
   
   std::shared_ptr<Material> aluminium = std::make_shared<Metal>(glm::vec3(0.8, 0.85, 0.88), 0.01); 
   
@@ -703,15 +647,7 @@ void prob_dens_func_test() {
   test_box = std::make_shared<RotateYAxis>(test_box, 15);
   
   world.add(test_box);
-  
-  std::shared_ptr<Hittable> test_box_light = std::make_shared<Box>(
-    glm::dvec3(190, 0, 190),              // base min corner
-    glm::dvec3(280, 165, 280),            // top max corner (90 units high box)
-    empty_material// non-light material
-  );
-  test_box_light = std::make_shared<RotateYAxis>(test_box_light, 15);
-  lights.add(test_box_light);
-  
+
   auto test_cone = std::make_shared<Cone>(
     glm::dvec3(378, 0, 278),           // Base centered in Cornell Box
     glm::dvec3(65, 0, 0),              // u = 65 units wide
@@ -721,17 +657,6 @@ void prob_dens_func_test() {
     aluminium
   );
   world.add(test_cone);
-  
-  
-  auto test_cone_light = std::make_shared<Cone>(
-    glm::dvec3(378, 0, 278),           // Base centered in Cornell Box
-    glm::dvec3(65, 0, 0),              // u = 65 units wide
-    glm::dvec3(0, 0, -65),              // v = 65 units deep
-    120,                               // Height up to 120
-    32,
-    empty_material
-  );
-  lights.add(test_cone_light);
 
   std::shared_ptr<Hittable> test_pyramid = std::make_shared<Pyramid>(
     glm::dvec3(178, 0, 278),           // Base centered in Cornell Box
@@ -743,15 +668,6 @@ void prob_dens_func_test() {
   //test_pyramid = std::make_shared<RotateYAxis>(test_pyramid, 15);
   world.add(test_pyramid);
 
-  std::shared_ptr<Hittable> test_pyramid_light = std::make_shared<Pyramid>(
-    glm::dvec3(178, 0, 278),           // Base centered in Cornell Box
-    glm::dvec3(65, 0, 0),              // u = 65 units wide
-    glm::dvec3(0, 0, -65),              // v = 65 units deep
-    120,                               // Height up to 120
-    empty_material
-  );
-  lights.add(test_pyramid_light);
-
   Camera cam;
 
   cam.aspect_ratio = 1;
@@ -767,7 +683,7 @@ void prob_dens_func_test() {
 
   cam.defocus_angle = 0;
 
-  cam.render(world, lights);
+  cam.render(world);
 }
 
 void dipole_diffusion_profile_test() {
@@ -793,11 +709,6 @@ void dipole_diffusion_profile_test() {
   world.add(std::make_shared<Quad>(glm::dvec3(343, 554, 332), glm::dvec3(-130, 0, 0), glm::dvec3(0, 0, -105), dim_light));
   // Light source behind SSS sphere (bright small sphere)
   world.add(std::make_shared<Sphere>(glm::dvec3(375, 100, 430), 30.0, bright_light));
-  // Light Sources
-  std::shared_ptr<Material> empty_material = std::shared_ptr<Material>();
-  HitPool lights;
-  lights.add(std::make_shared<Quad>(glm::dvec3(343, 554, 332), glm::dvec3(-130, 0, 0), glm::dvec3(0, 0, -105), empty_material));
-  lights.add(std::make_shared<Sphere>(glm::dvec3(375, 100, 430), 30.0, empty_material));
 
   // Reference: plain red Lambertian
   auto lambertian_orange = std::make_shared<Lambertian>(glm::vec3(1.0, 0.5, 0.3));
@@ -830,12 +741,12 @@ void dipole_diffusion_profile_test() {
 
   cam.defocus_angle = 0;
 
-  cam.render(world, lights);
+  cam.render(world);
 }
 
 void sss_gallery()  // drop into main.cpp
 {
-  HitPool world, lights;
+  HitPool world;
 
   /* -- Cornell walls --------------------------------------------------- */
   auto red = std::make_shared<Lambertian>(glm::vec3(.65, .05, .05));
@@ -856,12 +767,9 @@ void sss_gallery()  // drop into main.cpp
   // ceiling panel (normal -y)
   world.add(std::make_shared<Quad>(glm::dvec3(343, 554, 332), glm::dvec3(-130, 0, 0),
     glm::dvec3(0, 0, -105), light_panel));
-  lights.add(std::make_shared<Quad>(glm::dvec3(343, 554, 332), glm::dvec3(-130, 0, 0),
-    glm::dvec3(0, 0, -105), nullptr));
 
   // back sphere light
   world.add(std::make_shared<Sphere>(glm::dvec3(278, 278, 520), 20, back_light));
-  lights.add(std::make_shared<Sphere>(glm::dvec3(278, 278, 520), 20, nullptr));
 
   /* -- Subsurface presets --------------------------------------------- */
   auto wax = std::make_shared<SubsurfaceMaterial>(
@@ -921,5 +829,144 @@ void sss_gallery()  // drop into main.cpp
   cam.view_up = glm::dvec3(0, 1, 0);
   cam.defocus_angle = 0;
 
-  cam.render(world, lights);
+  cam.render(world);
+}
+
+// Builds a finely tessellated torus (rings * sides * 2 triangles) with normals and uvs.
+std::shared_ptr<TriangleMesh> make_torus_mesh(int rings, int sides, std::shared_ptr<Material> material) {
+  const double major_radius = 150.0;
+  const double minor_radius = 60.0;
+  const glm::dvec3 torus_center(278, 230, 278);
+  const glm::dvec3 torus_axis = glm::normalize(glm::dvec3(0, 1, -1)); // Tilted towards the camera
+  const glm::dvec3 ring_u(1, 0, 0);
+  const glm::dvec3 ring_v = glm::cross(torus_axis, ring_u);
+
+  std::vector<glm::dvec3> positions, normals;
+  std::vector<glm::dvec2> uvs;
+  std::vector<uint32_t> indices;
+  positions.reserve(rings * sides);
+  normals.reserve(rings * sides);
+  uvs.reserve(rings * sides);
+  indices.reserve(rings * sides * 6);
+
+  for (int i = 0; i < rings; ++i) {
+    double theta = 2.0 * pi * i / rings;
+    glm::dvec3 ring_dir = std::cos(theta) * ring_u + std::sin(theta) * ring_v;
+    for (int j = 0; j < sides; ++j) {
+      double phi = 2.0 * pi * j / sides;
+      glm::dvec3 n = std::cos(phi) * ring_dir + std::sin(phi) * torus_axis;
+      positions.push_back(torus_center + major_radius * ring_dir + minor_radius * n);
+      normals.push_back(n);
+      uvs.push_back(glm::dvec2(double(i) / rings, double(j) / sides));
+    }
+  }
+  for (int i = 0; i < rings; ++i) {
+    for (int j = 0; j < sides; ++j) {
+      uint32_t a = i * sides + j;
+      uint32_t b = ((i + 1) % rings) * sides + j;
+      uint32_t c = ((i + 1) % rings) * sides + (j + 1) % sides;
+      uint32_t d = i * sides + (j + 1) % sides;
+      indices.insert(indices.end(), { a, d, b, b, d, c });
+    }
+  }
+
+  return std::make_shared<TriangleMesh>(positions, indices, material, normals, uvs);
+}
+
+void compressed_mesh_test(bool out_of_core) {
+  HitPool world;
+
+  // Materials
+  auto red = std::make_shared<Lambertian>(glm::vec3(.65, 0.05, 0.05));
+  auto white = std::make_shared<Lambertian>(glm::vec3(0.73, 0.73, 0.73));
+  auto green = std::make_shared<Lambertian>(glm::vec3(0.12, 0.45, 0.15));
+  auto light = std::make_shared<DiffuseLight>(glm::vec3(15.f));
+  auto checker = std::make_shared<Lambertian>(std::make_shared<CheckerTexture>(8.0, glm::vec3(0.2, 0.3, 0.1), glm::vec3(0.9, 0.9, 0.9)));
+
+  // Cornell box
+  world.add(std::make_shared<Quad>(glm::dvec3(555, 0, 0), glm::dvec3(0, 555, 0), glm::dvec3(0, 0, 555), green));
+  world.add(std::make_shared<Quad>(glm::dvec3(0, 0, 0), glm::dvec3(0, 555, 0), glm::dvec3(0, 0, 555), red));
+  world.add(std::make_shared<Quad>(glm::dvec3(0, 0, 0), glm::dvec3(555, 0, 0), glm::dvec3(0, 0, 555), white));
+  world.add(std::make_shared<Quad>(glm::dvec3(555, 555, 555), glm::dvec3(-555, 0, 0), glm::dvec3(0, 0, -555), white));
+  world.add(std::make_shared<Quad>(glm::dvec3(0, 0, 555), glm::dvec3(555, 0, 0), glm::dvec3(0, 555, 0), white));
+  world.add(std::make_shared<Quad>(glm::dvec3(343, 554, 332), glm::dvec3(-130, 0, 0), glm::dvec3(0, 0, -105), light));
+
+  // Finely tessellated torus (~1M triangles) stored with compressed vertices
+  auto torus = make_torus_mesh(1024, 512, checker);
+  std::clog << "Torus: " << torus->triangle_count() << " triangles, " << torus->memory_footprint() / (1024 * 1024) << " MiB\n";
+
+  // Out-of-core: page the torus back in from disk with a resident budget far below its size
+  std::shared_ptr<GeometryCache> geometry_cache;
+  if (out_of_core && torus->write_cache("torus.rtmesh", 256 << 10)) {
+    geometry_cache = std::make_shared<GeometryCache>(16 << 20);
+    torus = std::make_shared<TriangleMesh>(geometry_cache, "torus.rtmesh", checker);
+  }
+  world.add(torus);
+
+  Camera cam;
+
+  cam.aspect_ratio = 1;
+  cam.image_width = 600;
+  cam.samples_per_pixel = 100;
+  cam.max_depth = 50;
+  cam.background = glm::vec3(0.0, 0.0, 0.0); // Black background
+
+  cam.vertical_fov = 40;
+  cam.look_from = glm::dvec3(278, 278, -800);
+  cam.look_at = glm::dvec3(278, 278, 0);
+  cam.view_up = glm::dvec3(0, 1, 0);
+
+  cam.defocus_angle = 0;
+
+  cam.render(world);
+
+  if (geometry_cache) {
+    std::clog << "Geometry cache: " << geometry_cache->page_faults() << " page faults, " << geometry_cache->evictions() << " evictions, "
+              << geometry_cache->resident_bytes() / (1024 * 1024) << " MiB resident of " << geometry_cache->resident_budget() / (1024 * 1024) << " MiB budget\n";
+  }
+}
+
+void sky_spheres() {
+  // Outdoor lighting from an environment map alone, no light quads. The sky here is made up on the
+  // spot so the scene needs no file: a horizon to zenith gradient and a small, very bright sun.
+  // A panorama from disk works the same: std::make_shared<EnvironmentMap>("sky.hdr").
+  HitPool world;
+
+  world.add(std::make_shared<Sphere>(glm::dvec3(0, -1000, 0), 1000, std::make_shared<Lambertian>(glm::vec3(0.5f, 0.5f, 0.5f))));
+  world.add(std::make_shared<Sphere>(glm::dvec3(-4, 1, 0), 1.0, std::make_shared<Lambertian>(glm::vec3(0.7f, 0.3f, 0.2f))));
+  world.add(std::make_shared<Sphere>(glm::dvec3(0, 1, 0), 1.0, std::make_shared<Dielectric>(1.5)));
+  world.add(std::make_shared<Sphere>(glm::dvec3(4, 1, 0), 1.0, std::make_shared<Metal>(glm::vec3(0.8f, 0.8f, 0.7f), 0.1)));
+
+  const int sky_width = 512, sky_height = 256;
+  const glm::dvec3 sun_direction = glm::normalize(glm::dvec3(1.0, 1.2, 0.6));
+  const double sun_cos_radius = std::cos(degrees_to_radians(1.5));
+  std::vector<glm::vec3> sky(size_t(sky_width) * sky_height);
+  for (int y = 0; y < sky_height; ++y) {
+    for (int x = 0; x < sky_width; ++x) {
+      const double theta = pi * (y + 0.5) / sky_height;
+      const double phi = 2.0 * pi * (x + 0.5) / sky_width;
+      const glm::dvec3 direction(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+      const float up = float(std::max(direction.y, 0.0));
+      glm::vec3 color = glm::mix(glm::vec3(0.9f, 0.9f, 1.0f), glm::vec3(0.3f, 0.5f, 1.0f), up);
+      if (glm::dot(direction, sun_direction) > sun_cos_radius)
+        color = glm::vec3(2000.0f, 1800.0f, 1500.0f);
+      sky[size_t(y) * sky_width + x] = color;
+    }
+  }
+
+  Camera cam;
+
+  cam.aspect_ratio = 16.0 / 9.0;
+  cam.image_width = 400;
+  cam.samples_per_pixel = 64;
+  cam.max_depth = 20;
+  cam.environment = std::make_shared<EnvironmentMap>(sky_width, sky_height, std::move(sky));
+  cam.tonemap = Tonemap::aces;
+
+  cam.vertical_fov = 25;
+  cam.look_from = glm::dvec3(0, 3, 14);
+  cam.look_at = glm::dvec3(0, 1, 0);
+  cam.view_up = glm::dvec3(0, 1, 0);
+
+  cam.render(world);
 }
@@ -70,4 +70,13 @@ glm::dvec3 Box::random(const glm::dvec3& origin) const {
   }
   // fallback, shouldn't happen
   return face_list[5]->random(origin);
+}
+
+// Hits report the face as prim, so each emissive face is its own light.
+void Box::collect_emitters(std::vector<const Hittable*>& emitters) const {
+  sides_bvh->collect_emitters(emitters);
+}
+
+bool Box::light_bounds(LightBounds& bounds) const {
+  return sides_bvh->light_bounds(bounds);
 }
\ No newline at end of file
@@ -97,3 +97,13 @@ glm::dvec3 Cylindroid::random(const glm::dvec3& origin) const {
 AABB Cylindroid::bounding_box() const {
   return sides_bvh->bounding_box();
 }
+
+
+// Hits report the face as prim, so each emissive face is its own light.
+void Cylindroid::collect_emitters(std::vector<const Hittable*>& emitters) const {
+  sides_bvh->collect_emitters(emitters);
+}
+
+bool Cylindroid::light_bounds(LightBounds& bounds) const {
+  return sides_bvh->light_bounds(bounds);
+}
\ No newline at end of file
@@ -13,8 +13,9 @@ public:
     bbox = AABB(Q - u - v, Q + u + v);
   }
 
-  double surface_area() const {
-    return pi * glm::length(u) * glm::length(v);
+  double surface_area() const override {
+    // u and v span the whole ellipse, its semi-axes are half as long.
+    return pi * glm::length(u) * glm::length(v) / 4.0;
   }
 
   virtual bool is_interior(double a, double b, HitRecord& rec) const override {
@@ -29,26 +30,30 @@ public:
     return true;
   }
 
-  virtual double pdf_value(const glm::dvec3& origin, const glm::dvec3& direction) const {
-    Ray r(origin, direction);
-    HitRecord rec;
-    if (!this->hit(r, Interval(0.001, infinity), rec))
+  virtual double pdf_value(const glm::dvec3& origin, const glm::dvec3& direction) const override {
+    // Sampled by area, ellipses have no cheap solid angle parametrization.
+    double t = crossing(origin, direction);
+    if (t <= 0.0)
       return 0;
 
-    double distance_squared = rec.t * rec.t * glm::length2(direction);
-    double cosine = glm::abs(glm::dot(direction, rec.normal) / glm::length(direction));
-
-    return distance_squared / (cosine * surface_area());
+    return area_pdf(direction, t);
   }
 
-  virtual glm::dvec3 random(const glm::dvec3& origin) const {
+  virtual glm::dvec3 random(const glm::dvec3& origin) const override {
     // Uniformly sample a point inside a unit disk
     glm::dvec2 disk = random_in_unit_disk(); // returns vec2(x, y) with x^2 + y^2 <= 1
 
-    glm::dvec3 sample_point = Q + disk.x * u + disk.y * v;
+    // Q is a corner of the parallelogram around the ellipse, the disk maps onto it from its center.
+    glm::dvec3 sample_point = Q + 0.5 * (u + v) + 0.5 * (disk.x * u + disk.y * v);
     return sample_point - origin;
   }
 
+  virtual glm::dvec3 sample_direction(const glm::dvec3& origin, double& pdf) const override {
+    glm::dvec3 direction = random(origin);
+    pdf = area_pdf(direction, 1.0);
+    return direction;
+  }
+
   glm::dvec3 normal_at(const glm::dvec3& /*p*/) const {
     return normal; // Flat surface, same normal everywhere
   }
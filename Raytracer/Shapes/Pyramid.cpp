@@ -105,4 +105,13 @@ glm::dvec3 Pyramid::random(const glm::dvec3& origin) const {
 
   // Fallback (should not happen)
   return face_list.back()->random(origin);
+}
+
+// Hits report the face as prim, so each emissive face is its own light.
+void Pyramid::collect_emitters(std::vector<const Hittable*>& emitters) const {
+  sides_bvh->collect_emitters(emitters);
+}
+
+bool Pyramid::light_bounds(LightBounds& bounds) const {
+  return sides_bvh->light_bounds(bounds);
 }
\ No newline at end of file
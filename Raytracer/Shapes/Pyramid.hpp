@@ -13,6 +13,8 @@ public:
   virtual AABB bounding_box() const override;
   virtual double pdf_value(const glm::dvec3& origin, const glm::dvec3& direction) const override;
   virtual glm::dvec3 random(const glm::dvec3& origin) const override;
+  virtual void collect_emitters(std::vector<const Hittable*>& emitters) const override;
+  virtual bool light_bounds(LightBounds& bounds) const override;
 
 private:
   std::shared_ptr<Hittable> sides_bvh;
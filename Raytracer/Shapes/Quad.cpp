@@ -1,5 +1,7 @@
 #include "Quad.hpp"
 #include "../Constants.hpp"
+#include "../LightBVH.hpp"
+#include "../SphericalSampling.hpp"
 
 Quad::Quad(const glm::dvec3& Q, const glm::dvec3& u, const glm::dvec3& v, std::shared_ptr<Material> material)
   : Q(Q), u(u), v(v), material(material) 
@@ -9,6 +11,7 @@ Quad::Quad(const glm::dvec3& Q, const glm::dvec3& u, const glm::dvec3& v, std::s
   D = glm::dot(normal, Q);
   w = n / dot(n, n);
   area = glm::length(n);
+  rectangular = glm::abs(glm::dot(u, v)) < 1e-6 * glm::length(u) * glm::length(v);
   set_bounding_box();
 }
 
@@ -40,20 +43,23 @@ bool Quad::hit(const Ray& ray, Interval ray_t, HitRecord& rec) const
   if (!is_interior(alpha, beta, rec))
     return false;
 
-  // Ray hits the 2D shape; set the rest of the hit record and return true.
+  // Ray hits the 2D shape; the surface attributes are filled in by surface_interaction().
   rec.t = t;
-  rec.p = intersection;
-  rec.material = material;
-  rec.set_face_normal(ray, glm::normalize(normal));
+  rec.prim = this;
+  rec.prim_id = 0;
   rec.shape_ptr = this;
 
-  if (glm::dot(rec.normal, ray.direction()) > 0)
-    std::cerr << "WARNING: Backface normal detected\n";
-
-
   return true;
 }
 
+void Quad::surface_interaction(const Ray& ray, HitRecord& rec) const
+{
+  // u, v already hold the plane coordinates set by is_interior()
+  rec.p = ray.at(rec.t);
+  rec.material = material.get();
+  rec.set_face_normal(ray, normal);
+}
+
 bool Quad::is_interior(double a, double b, HitRecord& rec) const
 {
   Interval unit_interval = Interval(0.0, 1.0);
@@ -69,20 +75,63 @@ bool Quad::is_interior(double a, double b, HitRecord& rec) const
   return true;
 }
 
-double Quad::pdf_value(const glm::dvec3& origin, const glm::dvec3& direction) const {
+double Quad::crossing(const glm::dvec3& origin, const glm::dvec3& direction) const
+{
+  double denom = glm::dot(normal, direction);
+  if (glm::abs(denom) < 1e-8) return 0.0;
+
+  double t = (D - glm::dot(normal, origin)) / denom;
+  if (t < 0.001) return 0.0;
+
+  glm::dvec3 planar_hitpoint_vector = origin + t * direction - Q;
   HitRecord rec;
-  if (!this->hit(Ray(origin, direction), Interval(0.001, infinity), rec))
+  if (!is_interior(glm::dot(w, glm::cross(planar_hitpoint_vector, v)), glm::dot(w, glm::cross(u, planar_hitpoint_vector)), rec))
+    return 0.0;
+  return t;
+}
+
+double Quad::area_pdf(const glm::dvec3& direction, double t) const
+{
+  double distance_squared = t * t * glm::length2(direction);
+  double cosine = glm::abs(glm::dot(direction, normal) / glm::length(direction));
+  if (cosine < 1e-8)
     return 0;
 
-  double distance_squared = rec.t * rec.t * glm::length2(direction);
-  double cosine = glm::abs(glm::dot(direction, rec.normal) / glm::length(direction));
+  return distance_squared / (cosine * surface_area());
+}
+
+double Quad::pdf_value(const glm::dvec3& origin, const glm::dvec3& direction) const {
+  double t = crossing(origin, direction);
+  if (t <= 0.0)
+    return 0;
 
-  const double res = distance_squared / (cosine * area);
-  return res;
+  // Must make the same choice between solid angle and area sampling as random() does for origin.
+  if (rectangular) {
+    SphericalRectangle rectangle(Q, u, v, origin);
+    if (use_spherical_sampling(rectangle.solid_angle()))
+      return 1.0 / rectangle.solid_angle();
+  }
+  return area_pdf(direction, t);
 }
 
 glm::dvec3 Quad::random(const glm::dvec3& origin) const {
-  glm::dvec3 random_point = Q + (u * random_double()) + (v * random_double());
+  double pdf;
+  return sample_direction(origin, pdf);
+}
+
+glm::dvec3 Quad::sample_direction(const glm::dvec3& origin, double& pdf) const {
+  if (rectangular) {
+    SphericalRectangle rectangle(Q, u, v, origin);
+    if (use_spherical_sampling(rectangle.solid_angle())) {
+      glm::dvec2 r = random_double_2d();
+      pdf = 1.0 / rectangle.solid_angle();
+      return rectangle.sample(r.x, r.y) - origin;
+    }
+  }
+
+  glm::dvec2 r = random_double_2d();
+  glm::dvec3 random_point = Q + (u * r.x) + (v * r.y);
+  pdf = area_pdf(random_point - origin, 1.0);
   return random_point - origin;
 }
 
@@ -101,3 +150,24 @@ glm::dvec3 Quad::uv_to_world(const glm::dvec2& uv) const {
 glm::dvec3 Quad::normal_at(const glm::dvec3& p) const {
   return normal; // Flat surface, same normal everywhere
 }
+
+
+void Quad::collect_emitters(std::vector<const Hittable*>& emitters) const {
+  if (material && material->average_emission() != glm::vec3(0.f))
+    emitters.push_back(this);
+}
+
+bool Quad::light_bounds(LightBounds& bounds) const {
+  if (!material) return false;
+  glm::vec3 emission = material->average_emission();
+  if (emission == glm::vec3(0.f)) return false;
+
+  // One-sided diffuse emitter around the plane normal, pi * L * area.
+  bounds.bounds = bbox;
+  bounds.w = normal;
+  bounds.phi = pi * (emission.x + emission.y + emission.z) / 3.0 * surface_area();
+  bounds.cos_theta_o = 1.0;
+  bounds.cos_theta_e = 0.0;
+  bounds.two_sided = false;
+  return true;
+}
\ No newline at end of file
@@ -18,23 +18,38 @@ class Quad : public Hittable {
 
     inline virtual AABB bounding_box() const override { return bbox; }
 
-    inline double surface_area() const { return bbox.surface_area(); }
+    virtual double surface_area() const { return area; }
 
     virtual bool hit(const Ray& ray, Interval ray_t, HitRecord& rec) const override;
 
+    virtual void surface_interaction(const Ray& ray, HitRecord& rec) const override;
+
     virtual bool is_interior(double a, double b, HitRecord& rec) const;
 
     virtual double pdf_value(const glm::dvec3& origin, const glm::dvec3& direction) const override;
 
     virtual glm::dvec3 random(const glm::dvec3& origin) const override;
 
+    virtual glm::dvec3 sample_direction(const glm::dvec3& origin, double& pdf) const override;
+
     virtual glm::dvec3 normal_at(const glm::dvec3& p) const override;
 
+    virtual void collect_emitters(std::vector<const Hittable*>& emitters) const override;
+
+    virtual bool light_bounds(LightBounds& bounds) const override;
+
   protected:
     glm::dvec2 world_to_uv(const glm::dvec3& p) const;
 
     glm::dvec3 uv_to_world(const glm::dvec2& uv) const;
 
+    // Distance along direction at which the ray from origin crosses the shape, 0 if it misses.
+    // Same test as hit(), without building a ray or a hit record.
+    double crossing(const glm::dvec3& origin, const glm::dvec3& direction) const;
+
+    // Solid angle density of uniform area sampling, for a direction crossing the shape at t.
+    double area_pdf(const glm::dvec3& direction, double t) const;
+
     glm::dvec3 Q; // origin of the quad
     glm::dvec3 u , v; // vectors spanning the edges of the quad
     glm::dvec3 w; // constant from a vector orthogonal to the quad w = n / dot(n, (u x v)); is this the unit/normalized normal vector of the quad?
@@ -44,5 +59,6 @@ class Quad : public Hittable {
     glm::dvec3 normal;
     double area;
     double D;
+    bool rectangular; // u and v are orthogonal, so the quad can be sampled by solid angle
 
 };
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "Quad.hpp"
 #include "Sphere.hpp"
 #include "Triangle.hpp"
+#include "TriangleMesh.hpp"
 
 
 
@@ -1,4 +1,6 @@
 #include "Sphere.hpp"
+#include "../LightBVH.hpp"
+#include "../Material.hpp"
 #include "../Utilities.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtx/norm.hpp>
@@ -26,16 +28,21 @@ bool Sphere::hit(const Ray& ray, Interval interval, HitRecord& rec) const {
         }
     }
     rec.t = root;
-    rec.p = ray.at(rec.t); // Point of intersection
-    glm::dvec3 outward_normal = (rec.p - current_center) / radius; // Normalized normal vector
-    rec.set_face_normal(ray, outward_normal); // Normal at the intersection point
-    get_sphere_uv(outward_normal, rec.u, rec.v); // Texture coordinates
-    rec.material = mat; // Material of the sphere
+    rec.prim = this;
+    rec.prim_id = 0;
     rec.shape_ptr = this;
 
     return true;
 }
 
+void Sphere::surface_interaction(const Ray& ray, HitRecord& rec) const {
+  rec.p = ray.at(rec.t); // Point of intersection
+  glm::dvec3 outward_normal = (rec.p - center.at(ray.time())) / radius; // Normalized normal vector
+  rec.set_face_normal(ray, outward_normal); // Normal at the intersection point
+  get_sphere_uv(outward_normal, rec.u, rec.v); // Texture coordinates
+  rec.material = mat.get(); // Material of the sphere
+}
+
 // This doesn't work for dynamic spheres
 bool Sphere::contains(const glm::dvec3& p) const {
   return glm::length2(p - center.origin()) < radius * radius;
@@ -57,8 +64,9 @@ void Sphere::get_sphere_uv(const glm::dvec3& p, double& u, double& v) {
 
 glm::dvec3 Sphere::random_to_sphere(double radius, double distance_squared)
 {
-  double r1 = random_double();
-  double r2 = random_double();
+  glm::dvec2 u = random_double_2d();
+  double r1 = u.x;
+  double r2 = u.y;
   double z = 1 + r2 * (std::sqrt(1 - radius * radius / distance_squared) - 1);
 
   auto phi = 2 * pi * r1;
@@ -92,3 +100,23 @@ glm::dvec3 Sphere::random(const glm::dvec3& origin) const {
 glm::dvec3 Sphere::normal_at(const glm::dvec3& p) const {
   return glm::normalize(p - center.origin());
 }
+
+void Sphere::collect_emitters(std::vector<const Hittable*>& emitters) const {
+  if (mat && mat->average_emission() != glm::vec3(0.f))
+    emitters.push_back(this);
+}
+
+bool Sphere::light_bounds(LightBounds& bounds) const {
+  if (!mat) return false;
+  glm::vec3 emission = mat->average_emission();
+  if (emission == glm::vec3(0.f)) return false;
+
+  // Emits in every direction, pi * L * area for a diffuse emitter.
+  bounds.bounds = bbox;
+  bounds.w = glm::dvec3(0, 0, 1);
+  bounds.phi = pi * (emission.x + emission.y + emission.z) / 3.0 * 4.0 * pi * radius * radius;
+  bounds.cos_theta_o = -1.0;
+  bounds.cos_theta_e = 0.0;
+  bounds.two_sided = false;
+  return true;
+}
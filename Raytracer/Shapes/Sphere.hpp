@@ -29,6 +29,8 @@ class Sphere : public Hittable {
 
     bool hit(const Ray& ray, Interval t, HitRecord& rec) const override;
 
+    void surface_interaction(const Ray& ray, HitRecord& rec) const override;
+
     bool contains(const glm::dvec3& p) const override;
 
     AABB bounding_box() const override { return bbox; }
@@ -39,6 +41,10 @@ class Sphere : public Hittable {
 
     glm::dvec3 normal_at(const glm::dvec3& p) const override;
 
+    void collect_emitters(std::vector<const Hittable*>& emitters) const override;
+
+    bool light_bounds(LightBounds& bounds) const override;
+
   private:
     static void get_sphere_uv(const glm::dvec3& p, double& u, double& v);
     static glm::dvec3 random_to_sphere(double radius, double distance_squared);
@@ -1,5 +1,6 @@
 #pragma once 
 #include "Quad.hpp"
+#include "../SphericalSampling.hpp"
 
 class Triangle : public Quad {
 public:
@@ -17,35 +18,46 @@ public:
     return true;
   }
 
-  double surface_area() const {
+  double surface_area() const override {
     return 0.5 * glm::length(glm::cross(u, v));
   }
 
-  virtual double pdf_value(const glm::dvec3& origin, const glm::dvec3& direction) const {
-    Ray r(origin, direction);
-    HitRecord rec;
-
-    if (!this->hit(r, Interval(0.001, infinity), rec))
+  virtual double pdf_value(const glm::dvec3& origin, const glm::dvec3& direction) const override {
+    double t = crossing(origin, direction);
+    if (t <= 0.0)
       return 0;
 
-    double distance_squared = rec.t * rec.t * glm::length2(r.direction());
-    double cosine = glm::abs(glm::dot(direction, rec.normal) / glm::length(r.direction()));
-    if (cosine < 1e-6)
-      return 0;
+    // Must make the same choice between solid angle and area sampling as random() does for origin.
+    SphericalTriangle triangle(Q, Q + u, Q + v, origin);
+    if (use_spherical_sampling(triangle.solid_angle()))
+      return 1.0 / triangle.solid_angle();
 
-    // Triangle area = 0.5 * |u  v|, already stored in area from Quad constructor
-    return distance_squared / (cosine * surface_area());
+    return area_pdf(direction, t);
   }
 
-  virtual glm::dvec3 random(const glm::dvec3& origin) const {
+  virtual glm::dvec3 random(const glm::dvec3& origin) const override {
+    double pdf;
+    return sample_direction(origin, pdf);
+  }
+
+  virtual glm::dvec3 sample_direction(const glm::dvec3& origin, double& pdf) const override {
+    SphericalTriangle triangle(Q, Q + u, Q + v, origin);
+    if (use_spherical_sampling(triangle.solid_angle())) {
+      glm::dvec2 uv = random_double_2d();
+      pdf = 1.0 / triangle.solid_angle();
+      return triangle.sample(uv.x, uv.y);
+    }
+
     // Uniform random point in triangle using barycentric sampling
-    double sqrt_r1 = std::sqrt(random_double());
-    double r2 = random_double();
+    glm::dvec2 r = random_double_2d();
+    double sqrt_r1 = std::sqrt(r.x);
+    double r2 = r.y;
     double a = 1.0 - sqrt_r1;
     double b = sqrt_r1 * (1.0 - r2);
     double c = sqrt_r1 * r2;
 
     glm::dvec3 random_point = Q + a * glm::dvec3(0.0) + b * u + c * v; // u and v come from Quad
+    pdf = area_pdf(random_point - origin, 1.0);
     return random_point - origin;
   }
 
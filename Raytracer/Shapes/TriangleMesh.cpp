@@ -0,0 +1,484 @@
+#include "TriangleMesh.hpp"
+#include "../Compression.hpp"
+#include "../Material.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+namespace {
+  constexpr size_t max_triangles_per_leaf = 4;
+  constexpr char cache_magic[8] = { 'R', 'T', 'M', 'E', 'S', 'H', '0', '1' };
+
+  // First page of a mesh cache file.
+  struct CacheHeader {
+    char magic[8];
+    uint32_t page_size;
+    uint32_t padding;
+    double quantization_min[3];
+    double quantization_step[3];
+    double bounds_min[3];
+    double bounds_max[3];
+    TriangleMesh::Layout layout;
+  };
+
+  float round_down(double value) {
+    float f = static_cast<float>(value);
+    return (f > value) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+  }
+
+  float round_up(double value) {
+    float f = static_cast<float>(value);
+    return (f < value) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+  }
+
+  bool node_hit(const TriangleMesh::Node& node, const glm::dvec3& origin, const glm::dvec3& inv_dir, double t_min, double t_max) {
+    for (int axis = 0; axis < 3; ++axis) {
+      double t0 = (node.bounds_min[axis] - origin[axis]) * inv_dir[axis];
+      double t1 = (node.bounds_max[axis] - origin[axis]) * inv_dir[axis];
+      if (t0 > t1) std::swap(t0, t1);
+      // fmax/fmin drop the NaN produced by 0 * inf on flat boxes
+      t_min = std::fmax(t0, t_min);
+      t_max = std::fmin(t1, t_max);
+      if (t_max < t_min) return false;
+    }
+    return true;
+  }
+}
+
+// Element accessors used by the intersection kernel. Both return elements by value so the paged
+// view is free to unpin a page as soon as it moves on to the next one.
+struct TriangleMesh::MemoryView {
+  const TriangleMesh& mesh;
+
+  Node node(uint32_t i) { return mesh.nodes[i]; }
+  TriangleIndices triangle(uint32_t i) { return mesh.triangles[i]; }
+  QuantizedPosition position(uint32_t i) { return mesh.positions[i]; }
+  uint32_t normal(uint32_t i) { return mesh.packed_normals[i]; }
+  uint32_t uv(uint32_t i) { return mesh.packed_uvs[i]; }
+};
+
+struct TriangleMesh::PagedView {
+  // Keeps one page per array pinned for the duration of a hit() call.
+  struct Slot {
+    uint64_t page = std::numeric_limits<uint64_t>::max();
+    const std::byte* data = nullptr;
+  };
+
+  GeometryCache& cache;
+  int file;
+  const Layout& layout;
+  Slot node_slot, triangle_slot, position_slot, normal_slot, uv_slot;
+
+  PagedView(GeometryCache& cache, int file, const Layout& layout) : cache(cache), file(file), layout(layout) {}
+
+  ~PagedView() {
+    for (Slot* slot : { &node_slot, &triangle_slot, &position_slot, &normal_slot, &uv_slot })
+      if (slot->data) cache.unpin(file, slot->page);
+  }
+
+  template <typename T>
+  T fetch(Slot& slot, const ArrayLayout& array, uint64_t i) {
+    uint64_t page = array.first_page + i / array.elements_per_page;
+    if (page != slot.page) {
+      if (slot.data) cache.unpin(file, slot.page);
+      slot.data = cache.pin(file, page);
+      slot.page = page;
+    }
+    T value;
+    std::memcpy(&value, slot.data + (i % array.elements_per_page) * array.element_size, sizeof(T));
+    return value;
+  }
+
+  Node node(uint32_t i) { return fetch<Node>(node_slot, layout.nodes, i); }
+  TriangleIndices triangle(uint32_t i) { return fetch<TriangleIndices>(triangle_slot, layout.triangles, i); }
+  QuantizedPosition position(uint32_t i) { return fetch<QuantizedPosition>(position_slot, layout.positions, i); }
+  uint32_t normal(uint32_t i) { return fetch<uint32_t>(normal_slot, layout.normals, i); }
+  uint32_t uv(uint32_t i) { return fetch<uint32_t>(uv_slot, layout.uvs, i); }
+};
+
+TriangleMesh::TriangleMesh(const std::vector<glm::dvec3>& in_positions, const std::vector<uint32_t>& in_indices, std::shared_ptr<Material> material,
+                           const std::vector<glm::dvec3>& in_normals, const std::vector<glm::dvec2>& in_uvs)
+  : material(material)
+{
+  // Quantize positions against the mesh bounds.
+  glm::dvec3 min_point(infinity), max_point(-infinity);
+  for (const glm::dvec3& p : in_positions) {
+    min_point = glm::min(min_point, p);
+    max_point = glm::max(max_point, p);
+  }
+  glm::dvec3 extent = max_point - min_point;
+  quantization_min = min_point;
+  quantization_step = extent / 65535.0;
+
+  positions.reserve(in_positions.size());
+  for (const glm::dvec3& p : in_positions) {
+    positions.push_back({
+      quantize_unorm16(p.x, min_point.x, extent.x > 0.0 ? 1.0 / extent.x : 0.0),
+      quantize_unorm16(p.y, min_point.y, extent.y > 0.0 ? 1.0 / extent.y : 0.0),
+      quantize_unorm16(p.z, min_point.z, extent.z > 0.0 ? 1.0 / extent.z : 0.0)
+    });
+  }
+
+  if (in_normals.size() == in_positions.size()) {
+    packed_normals.reserve(in_normals.size());
+    for (const glm::dvec3& n : in_normals)
+      packed_normals.push_back(encode_octahedral(n));
+  }
+
+  if (in_uvs.size() == in_positions.size()) {
+    packed_uvs.reserve(in_uvs.size());
+    for (const glm::dvec2& uv : in_uvs)
+      packed_uvs.push_back(encode_half2(uv.x, uv.y));
+  }
+
+  size_t triangle_total = in_indices.size() / 3;
+  triangles.resize(triangle_total);
+  for (size_t i = 0; i < triangle_total; ++i)
+    triangles[i] = { { in_indices[3 * i], in_indices[3 * i + 1], in_indices[3 * i + 2] } };
+
+  // Build the BVH over the decoded (quantized) vertices so node bounds are conservative.
+  std::vector<uint32_t> order(triangle_total);
+  std::vector<glm::dvec3> centroids(triangle_total);
+  for (size_t i = 0; i < triangle_total; ++i) {
+    order[i] = static_cast<uint32_t>(i);
+    centroids[i] = (decode_position(positions[triangles[i].v[0]])
+      + decode_position(positions[triangles[i].v[1]])
+      + decode_position(positions[triangles[i].v[2]])) / 3.0;
+  }
+
+  if (triangle_total > 0) {
+    nodes.reserve(2 * triangle_total / max_triangles_per_leaf + 1);
+    build_node(order, centroids, 0, triangle_total);
+  }
+
+  // Reorder the triangles so every leaf references a contiguous range.
+  std::vector<TriangleIndices> ordered(triangle_total);
+  for (size_t i = 0; i < triangle_total; ++i)
+    ordered[i] = triangles[order[i]];
+  triangles.swap(ordered);
+
+  layout.nodes.count = nodes.size();
+  layout.positions.count = positions.size();
+  layout.normals.count = packed_normals.size();
+  layout.uvs.count = packed_uvs.size();
+  layout.triangles.count = triangles.size();
+
+  bbox = triangle_total > 0
+    ? AABB(glm::dvec3(nodes[0].bounds_min[0], nodes[0].bounds_min[1], nodes[0].bounds_min[2]),
+           glm::dvec3(nodes[0].bounds_max[0], nodes[0].bounds_max[1], nodes[0].bounds_max[2]))
+    : AABB::empty;
+}
+
+TriangleMesh::TriangleMesh(std::shared_ptr<GeometryCache> cache, const std::string& cache_path, std::shared_ptr<Material> material)
+  : material(material)
+{
+  bbox = AABB::empty;
+
+  CacheHeader header;
+  std::ifstream in(cache_path, std::ios::binary);
+  if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0) {
+    std::cerr << "ERROR: '" << cache_path << "' is not a mesh cache file.\n";
+    return;
+  }
+
+  int file = cache->open(cache_path, header.page_size);
+  if (file < 0) return;
+
+  this->cache = cache;
+  cache_file = file;
+  layout = header.layout;
+  quantization_min = glm::dvec3(header.quantization_min[0], header.quantization_min[1], header.quantization_min[2]);
+  quantization_step = glm::dvec3(header.quantization_step[0], header.quantization_step[1], header.quantization_step[2]);
+  bbox = AABB(glm::dvec3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]),
+              glm::dvec3(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]));
+}
+
+bool TriangleMesh::write_cache(const std::string& path, size_t page_size) const {
+  if (cache) {
+    std::cerr << "ERROR: Mesh is already paged from a cache file.\n";
+    return false;
+  }
+
+  // The header and every array element have to fit in a page.
+  const size_t min_page_size = std::max(sizeof(CacheHeader), sizeof(Node));
+  if (page_size < min_page_size || page_size > std::numeric_limits<uint32_t>::max()) {
+    std::cerr << "ERROR: Mesh cache page size " << page_size << " is outside [" << min_page_size << ", "
+              << std::numeric_limits<uint32_t>::max() << "] bytes.\n";
+    return false;
+  }
+
+  CacheHeader header = {};
+  std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+  header.page_size = static_cast<uint32_t>(page_size);
+  header.layout = layout;
+
+  // Lay the arrays out one after the other, starting after the header page.
+  uint64_t next_page = 1;
+  auto place = [&](ArrayLayout& array, size_t element_size) {
+    array.first_page = next_page;
+    array.element_size = static_cast<uint32_t>(element_size);
+    array.elements_per_page = static_cast<uint32_t>(page_size / element_size);
+    next_page += (array.count + array.elements_per_page - 1) / array.elements_per_page;
+  };
+  place(header.layout.nodes, sizeof(Node));
+  place(header.layout.positions, sizeof(QuantizedPosition));
+  place(header.layout.normals, sizeof(uint32_t));
+  place(header.layout.uvs, sizeof(uint32_t));
+  place(header.layout.triangles, sizeof(TriangleIndices));
+
+  for (int axis = 0; axis < 3; ++axis) {
+    header.quantization_min[axis] = quantization_min[axis];
+    header.quantization_step[axis] = quantization_step[axis];
+    header.bounds_min[axis] = bbox.axis_interval(axis).min;
+    header.bounds_max[axis] = bbox.axis_interval(axis).max;
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    std::cerr << "ERROR: Could not write mesh cache '" << path << "'.\n";
+    return false;
+  }
+
+  std::vector<char> page(page_size, 0);
+  std::memcpy(page.data(), &header, sizeof(header));
+  out.write(page.data(), page_size);
+
+  auto write_array = [&](const ArrayLayout& array, const void* data) {
+    const char* bytes = static_cast<const char*>(data);
+    for (uint64_t first = 0; first < array.count; first += array.elements_per_page) {
+      uint64_t count = std::min<uint64_t>(array.elements_per_page, array.count - first);
+      std::fill(page.begin(), page.end(), 0);
+      std::memcpy(page.data(), bytes + first * array.element_size, count * array.element_size);
+      out.write(page.data(), page_size);
+    }
+  };
+  write_array(header.layout.nodes, nodes.data());
+  write_array(header.layout.positions, positions.data());
+  write_array(header.layout.normals, packed_normals.data());
+  write_array(header.layout.uvs, packed_uvs.data());
+  write_array(header.layout.triangles, triangles.data());
+
+  return static_cast<bool>(out);
+}
+
+glm::dvec3 TriangleMesh::decode_position(const QuantizedPosition& q) const {
+  return glm::dvec3(
+    dequantize_unorm16(q.x, quantization_min.x, quantization_step.x),
+    dequantize_unorm16(q.y, quantization_min.y, quantization_step.y),
+    dequantize_unorm16(q.z, quantization_min.z, quantization_step.z)
+  );
+}
+
+uint32_t TriangleMesh::build_node(std::vector<uint32_t>& order, std::vector<glm::dvec3>& centroids, size_t start, size_t end) {
+  uint32_t node_index = static_cast<uint32_t>(nodes.size());
+  nodes.emplace_back();
+
+  glm::dvec3 bounds_min(infinity), bounds_max(-infinity);
+  glm::dvec3 centroid_min(infinity), centroid_max(-infinity);
+  for (size_t i = start; i < end; ++i) {
+    uint32_t tri = order[i];
+    for (int k = 0; k < 3; ++k) {
+      glm::dvec3 p = decode_position(positions[triangles[tri].v[k]]);
+      bounds_min = glm::min(bounds_min, p);
+      bounds_max = glm::max(bounds_max, p);
+    }
+    centroid_min = glm::min(centroid_min, centroids[tri]);
+    centroid_max = glm::max(centroid_max, centroids[tri]);
+  }
+
+  Node node;
+  for (int axis = 0; axis < 3; ++axis) {
+    node.bounds_min[axis] = round_down(bounds_min[axis]);
+    node.bounds_max[axis] = round_up(bounds_max[axis]);
+  }
+
+  size_t span = end - start;
+  if (span <= max_triangles_per_leaf) {
+    node.offset = static_cast<uint32_t>(start);
+    node.count = static_cast<uint16_t>(span);
+    node.axis = 0;
+    nodes[node_index] = node;
+    return node_index;
+  }
+
+  // Same policy as BVHNode: split at the median along the longest axis.
+  glm::dvec3 centroid_extent = centroid_max - centroid_min;
+  int axis = (centroid_extent.x > centroid_extent.y)
+    ? (centroid_extent.x > centroid_extent.z ? 0 : 2)
+    : (centroid_extent.y > centroid_extent.z ? 1 : 2);
+
+  size_t mid = start + span / 2;
+  std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end,
+    [&centroids, axis](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+
+  build_node(order, centroids, start, mid);
+  node.offset = build_node(order, centroids, mid, end);
+  node.count = 0;
+  node.axis = static_cast<uint16_t>(axis);
+  nodes[node_index] = node;
+  return node_index;
+}
+
+bool TriangleMesh::hit(const Ray& r, Interval ray_t, HitRecord& rec) const {
+  if (layout.nodes.count == 0) return false;
+
+  if (cache) {
+    PagedView view(*cache, cache_file, layout);
+    return hit_kernel(view, r, ray_t, rec);
+  }
+  MemoryView view{ *this };
+  return hit_kernel(view, r, ray_t, rec);
+}
+
+void TriangleMesh::hit_stream(std::span<const Ray> rays, Interval t, std::span<HitRecord> recs, std::span<const uint32_t> active) const {
+  if (layout.nodes.count == 0) return;
+
+  auto run = [&](auto& view) {
+    for (uint32_t i : active)
+      hit_kernel(view, rays[i], Interval(t.min, recs[i].t), recs[i]);
+  };
+  if (cache) {
+    PagedView view(*cache, cache_file, layout);
+    run(view);
+    return;
+  }
+  MemoryView view{ *this };
+  run(view);
+}
+
+void TriangleMesh::surface_interaction(const Ray& r, HitRecord& rec) const {
+  if (cache) {
+    PagedView view(*cache, cache_file, layout);
+    surface_kernel(view, r, rec);
+    return;
+  }
+  MemoryView view{ *this };
+  surface_kernel(view, r, rec);
+}
+
+template <typename View>
+bool TriangleMesh::hit_kernel(View& view, const Ray& r, Interval ray_t, HitRecord& rec) const {
+  const glm::dvec3& origin = r.origin();
+  const glm::dvec3 inv_dir = 1.0 / r.direction();
+
+  uint32_t stack[64];
+  int stack_size = 0;
+  uint32_t current = 0;
+
+  double closest = ray_t.max;
+  uint32_t best_triangle = 0;
+  bool hit_anything = false;
+  double best_b1 = 0.0, best_b2 = 0.0;
+
+  while (true) {
+    const Node node = view.node(current);
+    if (node_hit(node, origin, inv_dir, ray_t.min, closest)) {
+      if (node.count > 0) {
+        for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+          // Moller-Trumbore on the decoded vertices.
+          TriangleIndices tri = view.triangle(i);
+          glm::dvec3 p0 = decode_position(view.position(tri.v[0]));
+          glm::dvec3 e1 = decode_position(view.position(tri.v[1])) - p0;
+          glm::dvec3 e2 = decode_position(view.position(tri.v[2])) - p0;
+
+          glm::dvec3 pvec = glm::cross(r.direction(), e2);
+          double det = glm::dot(e1, pvec);
+          if (std::abs(det) < 1e-12) continue;
+          double inv_det = 1.0 / det;
+
+          glm::dvec3 tvec = origin - p0;
+          double b1 = glm::dot(tvec, pvec) * inv_det;
+          if (b1 < 0.0 || b1 > 1.0) continue;
+
+          glm::dvec3 qvec = glm::cross(tvec, e1);
+          double b2 = glm::dot(r.direction(), qvec) * inv_det;
+          if (b2 < 0.0 || b1 + b2 > 1.0) continue;
+
+          double t = glm::dot(e2, qvec) * inv_det;
+          if (t <= ray_t.min || t >= closest) continue;
+
+          closest = t;
+          best_triangle = i;
+          best_b1 = b1;
+          best_b2 = b2;
+          hit_anything = true;
+        }
+        if (stack_size == 0) break;
+        current = stack[--stack_size];
+      } else {
+        // Visit the child on the near side of the split first.
+        if (r.direction()[node.axis] < 0.0) {
+          stack[stack_size++] = current + 1;
+          current = node.offset;
+        } else {
+          stack[stack_size++] = node.offset;
+          current = current + 1;
+        }
+      }
+    } else {
+      if (stack_size == 0) break;
+      current = stack[--stack_size];
+    }
+  }
+
+  if (!hit_anything)
+    return false;
+
+  // Surface attributes are decoded later by surface_kernel(), once for the final closest hit.
+  rec.t = closest;
+  rec.u = best_b1;
+  rec.v = best_b2;
+  rec.prim = this;
+  rec.prim_id = best_triangle;
+  rec.shape_ptr = this;
+  return true;
+}
+
+template <typename View>
+void TriangleMesh::surface_kernel(View& view, const Ray& r, HitRecord& rec) const {
+  const TriangleIndices tri = view.triangle(rec.prim_id);
+  uint32_t i0 = tri.v[0];
+  uint32_t i1 = tri.v[1];
+  uint32_t i2 = tri.v[2];
+  const double best_b1 = rec.u;
+  const double best_b2 = rec.v;
+  double b0 = 1.0 - best_b1 - best_b2;
+
+  glm::dvec3 p0 = decode_position(view.position(i0));
+  glm::dvec3 geometric_normal = glm::normalize(glm::cross(decode_position(view.position(i1)) - p0, decode_position(view.position(i2)) - p0));
+
+  rec.p = r.at(rec.t);
+  rec.front_face = glm::dot(r.direction(), geometric_normal) < 0;
+
+  glm::dvec3 shading_normal = geometric_normal;
+  if (layout.normals.count > 0) {
+    shading_normal = glm::normalize(b0 * decode_octahedral(view.normal(i0))
+      + best_b1 * decode_octahedral(view.normal(i1))
+      + best_b2 * decode_octahedral(view.normal(i2)));
+    if (glm::dot(shading_normal, geometric_normal) < 0) shading_normal = -shading_normal;
+  }
+  rec.normal = rec.front_face ? shading_normal : -shading_normal;
+
+  if (layout.uvs.count > 0) {
+    glm::dvec2 uv = b0 * decode_half2(view.uv(i0)) + best_b1 * decode_half2(view.uv(i1)) + best_b2 * decode_half2(view.uv(i2));
+    rec.u = uv.x;
+    rec.v = uv.y;
+  }
+
+  rec.material = material.get();
+}
+
+size_t TriangleMesh::memory_footprint() const {
+  if (cache)
+    return static_cast<size_t>(cache->page_count(cache_file) * cache->page_size(cache_file));
+
+  return positions.size() * sizeof(QuantizedPosition)
+    + packed_normals.size() * sizeof(uint32_t)
+    + packed_uvs.size() * sizeof(uint32_t)
+    + triangles.size() * sizeof(TriangleIndices)
+    + nodes.size() * sizeof(Node);
+}
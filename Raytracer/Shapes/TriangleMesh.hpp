@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "../Hittable.hpp"
+#include "../AABB.hpp"
+#include "../Ray.hpp"
+#include "../Interval.hpp"
+#include "../GeometryCache.hpp"
+
+class Material;
+
+// Indexed triangle mesh with compressed vertex storage, meant for meshes with millions of triangles.
+// - Positions are quantized to 16 bits per axis relative to the mesh bounds.
+// - Normals are octahedral-encoded into 32 bits.
+// - UVs are stored as two half floats.
+// Triangles are kept in a flat, depth-first BVH private to the mesh, so a whole mesh costs a single
+// entry in the scene BVH. Vertices are decoded on the fly in the intersection kernel, and normals
+// and uvs only for the closest hit in surface_interaction().
+//
+// A mesh can either live in memory or be written to a cache file with write_cache() and reopened
+// out-of-core through a GeometryCache, in which case its vertices, triangles and BVH nodes are paged
+// in on demand under the cache's resident-memory budget.
+class TriangleMesh : public Hittable {
+public:
+  // In-memory mesh
+  TriangleMesh(const std::vector<glm::dvec3>& positions, const std::vector<uint32_t>& indices, std::shared_ptr<Material> material,
+               const std::vector<glm::dvec3>& normals = {}, const std::vector<glm::dvec2>& uvs = {});
+
+  // Out-of-core mesh paged from a file produced by write_cache()
+  TriangleMesh(std::shared_ptr<GeometryCache> cache, const std::string& cache_path, std::shared_ptr<Material> material);
+
+  bool hit(const Ray& r, Interval ray_t, HitRecord& rec) const override;
+
+  void surface_interaction(const Ray& r, HitRecord& rec) const override;
+
+  // Reuses one view, and therefore the pinned pages of a paged mesh, for the whole stream.
+  void hit_stream(std::span<const Ray> rays, Interval t, std::span<HitRecord> recs, std::span<const uint32_t> active) const override;
+
+  AABB bounding_box() const override { return bbox; }
+
+  size_t triangle_count() const { return layout.triangles.count; }
+
+  bool is_paged() const { return cache != nullptr; }
+
+  // Bytes used by the vertex, index and BVH arrays (the full file size for paged meshes).
+  size_t memory_footprint() const;
+
+  // Serializes an in-memory mesh into a page-aligned cache file. Returns false on I/O errors, or if
+  // page_size is too small to hold the header or a BVH node.
+  bool write_cache(const std::string& path, size_t page_size = GeometryCache::default_page_size) const;
+
+  struct QuantizedPosition {
+    uint16_t x, y, z;
+  };
+
+  struct TriangleIndices {
+    uint32_t v[3];
+  };
+
+  struct Node {
+    float bounds_min[3];
+    float bounds_max[3];
+    uint32_t offset; // First triangle for leaves, index of the second child for interior nodes
+    uint16_t count;  // Number of triangles in a leaf, 0 for interior nodes
+    uint16_t axis;   // Split axis, used to visit the nearest child first
+  };
+
+  // Placement of one array inside a cache file. Elements never straddle a page boundary.
+  struct ArrayLayout {
+    uint64_t first_page = 0;
+    uint64_t count = 0;
+    uint32_t element_size = 0;
+    uint32_t elements_per_page = 0;
+  };
+
+  struct Layout {
+    ArrayLayout nodes, positions, normals, uvs, triangles;
+  };
+
+private:
+  // In-memory storage
+  std::vector<QuantizedPosition> positions;
+  std::vector<uint32_t> packed_normals; // Octahedral, empty if the mesh has no normals
+  std::vector<uint32_t> packed_uvs;     // Half2, empty if the mesh has no uvs
+  std::vector<TriangleIndices> triangles; // Reordered to match the BVH leaves
+  std::vector<Node> nodes;
+
+  // Out-of-core storage
+  std::shared_ptr<GeometryCache> cache;
+  int cache_file = -1;
+
+  Layout layout;
+  glm::dvec3 quantization_min;  // Mesh bounds minimum
+  glm::dvec3 quantization_step; // Mesh extent / 65535 per axis
+  std::shared_ptr<Material> material;
+  AABB bbox;
+
+  struct MemoryView;
+  struct PagedView;
+
+  template <typename View>
+  bool hit_kernel(View& view, const Ray& r, Interval ray_t, HitRecord& rec) const;
+
+  template <typename View>
+  void surface_kernel(View& view, const Ray& r, HitRecord& rec) const;
+
+  glm::dvec3 decode_position(const QuantizedPosition& q) const;
+
+  uint32_t build_node(std::vector<uint32_t>& order, std::vector<glm::dvec3>& centroids, size_t start, size_t end);
+};
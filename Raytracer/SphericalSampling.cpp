@@ -0,0 +1,132 @@
+#include "SphericalSampling.hpp"
+#include "Constants.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtx/norm.hpp>
+
+namespace {
+  double safe_sqrt(double x) {
+    return std::sqrt(std::max(0.0, x));
+  }
+
+  double safe_acos(double x) {
+    return std::acos(std::clamp(x, -1.0, 1.0));
+  }
+
+  // Angle between two unit vectors, accurate for nearly parallel and anti-parallel vectors too.
+  double angle_between(const glm::dvec3& v1, const glm::dvec3& v2) {
+    if (glm::dot(v1, v2) < 0.0)
+      return pi - 2.0 * std::asin(std::min(1.0, glm::length(v1 + v2) / 2.0));
+    return 2.0 * std::asin(std::min(1.0, glm::length(v2 - v1) / 2.0));
+  }
+
+  // Component of v orthogonal to the unit vector w.
+  glm::dvec3 gram_schmidt(const glm::dvec3& v, const glm::dvec3& w) {
+    return v - glm::dot(v, w) * w;
+  }
+}
+
+SphericalRectangle::SphericalRectangle(const glm::dvec3& corner, const glm::dvec3& ex, const glm::dvec3& ey, const glm::dvec3& origin)
+  : origin(origin)
+{
+  // Local frame in which the rectangle spans [x0, x1] x [y0, y1] in the plane z = z0 < 0.
+  double ex_length = glm::length(ex);
+  double ey_length = glm::length(ey);
+  x = ex / ex_length;
+  y = ey / ey_length;
+  z = glm::cross(x, y);
+
+  glm::dvec3 d = corner - origin;
+  x0 = glm::dot(d, x);
+  y0 = glm::dot(d, y);
+  z0 = glm::dot(d, z);
+  if (z0 > 0.0) {
+    z = -z;
+    z0 = -z0;
+  }
+  x1 = x0 + ex_length;
+  y1 = y0 + ey_length;
+
+  // Seen edge on, the rectangle covers no solid angle.
+  if (z0 > -1e-10 * std::max(ex_length, ey_length))
+    return;
+
+  // Normals of the planes through origin and each edge, the rectangle's solid angle follows from
+  // the angles between them.
+  glm::dvec3 n0 = glm::normalize(glm::dvec3(0.0, z0, -y0));
+  glm::dvec3 n1 = glm::normalize(glm::dvec3(-z0, 0.0, x1));
+  glm::dvec3 n2 = glm::normalize(glm::dvec3(0.0, -z0, y1));
+  glm::dvec3 n3 = glm::normalize(glm::dvec3(z0, 0.0, -x0));
+
+  double g0 = safe_acos(-glm::dot(n0, n1));
+  double g1 = safe_acos(-glm::dot(n1, n2));
+  double g2 = safe_acos(-glm::dot(n2, n3));
+  double g3 = safe_acos(-glm::dot(n3, n0));
+
+  b0 = n0.z;
+  b1 = n2.z;
+  k = 2.0 * pi - g2 - g3;
+  area = std::max(0.0, g0 + g1 - k);
+}
+
+glm::dvec3 SphericalRectangle::sample(double u1, double u2) const {
+  // x of the vertical line splitting off a u1 fraction of the solid angle...
+  double au = u1 * area + k;
+  double fu = (std::cos(au) * b0 - b1) / std::sin(au);
+  double cu = std::clamp((fu > 0.0 ? 1.0 : -1.0) / std::sqrt(fu * fu + b0 * b0), -1.0, 1.0);
+  double xu = std::clamp(-(cu * z0) / safe_sqrt(1.0 - cu * cu), x0, x1);
+
+  // ...then y, uniform in the cosine of the elevation along that line.
+  double d = std::sqrt(xu * xu + z0 * z0);
+  double h0 = y0 / std::sqrt(d * d + y0 * y0);
+  double h1 = y1 / std::sqrt(d * d + y1 * y1);
+  double hv = h0 + u2 * (h1 - h0);
+  double hv2 = hv * hv;
+  double yv = (hv2 < 1.0 - 1e-6) ? (hv * d) / std::sqrt(1.0 - hv2) : y1;
+
+  return origin + xu * x + yv * y + z0 * z;
+}
+
+SphericalTriangle::SphericalTriangle(const glm::dvec3& va, const glm::dvec3& vb, const glm::dvec3& vc, const glm::dvec3& origin)
+{
+  a = glm::normalize(va - origin);
+  b = glm::normalize(vb - origin);
+  c = glm::normalize(vc - origin);
+
+  glm::dvec3 n_ab = glm::cross(a, b);
+  glm::dvec3 n_bc = glm::cross(b, c);
+  glm::dvec3 n_ca = glm::cross(c, a);
+  if (glm::length2(n_ab) == 0.0 || glm::length2(n_bc) == 0.0 || glm::length2(n_ca) == 0.0)
+    return; // Degenerate, seen edge on
+  n_ab = glm::normalize(n_ab);
+  n_bc = glm::normalize(n_bc);
+  n_ca = glm::normalize(n_ca);
+
+  // Girard's theorem, the solid angle is the spherical excess of the vertex angles.
+  alpha = angle_between(n_ab, -n_ca);
+  double beta = angle_between(n_bc, -n_ab);
+  double gamma = angle_between(n_ca, -n_bc);
+  area = std::max(0.0, alpha + beta + gamma - pi);
+}
+
+glm::dvec3 SphericalTriangle::sample(double u1, double u2) const {
+  // Vertex c' on the arc from a to c such that the sub-triangle a, b, c' holds a u1 fraction of
+  // the solid angle...
+  double area_u = pi + u1 * area;
+  double cos_alpha = std::cos(alpha);
+  double sin_alpha = std::sin(alpha);
+  double sin_phi = std::sin(area_u) * cos_alpha - std::cos(area_u) * sin_alpha;
+  double cos_phi = std::cos(area_u) * cos_alpha + std::sin(area_u) * sin_alpha;
+  double k1 = cos_phi + cos_alpha;
+  double k2 = sin_phi - sin_alpha * glm::dot(a, b);
+  double cos_bp = (k2 + (k2 * cos_phi - k1 * sin_phi) * cos_alpha) / ((k2 * sin_phi + k1 * cos_phi) * sin_alpha);
+  cos_bp = std::clamp(cos_bp, -1.0, 1.0);
+  double sin_bp = safe_sqrt(1.0 - cos_bp * cos_bp);
+  glm::dvec3 cp = cos_bp * a + sin_bp * glm::normalize(gram_schmidt(c, a));
+
+  // ...then a direction on the arc from b to c', uniform in the cosine of its angle to b.
+  double cos_theta = 1.0 - u2 * (1.0 - glm::dot(cp, b));
+  double sin_theta = safe_sqrt(1.0 - cos_theta * cos_theta);
+  return cos_theta * b + sin_theta * glm::normalize(gram_schmidt(cp, b));
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Solid angle sampling of planar emitters. Sampling the directions a light subtends from the
+// shading point, rather than points on its surface, gives every sample the same density
+// 1 / solid_angle, so large nearby lights no longer spend samples on their distant, grazing parts.
+//
+// Both parametrizations lose precision for lights that subtend next to nothing or nearly the
+// whole hemisphere, callers fall back to area sampling outside of these bounds (as PBRT v4 does).
+inline constexpr double min_spherical_sample_area = 3e-4;
+inline constexpr double max_spherical_sample_area = 6.22;
+
+inline bool use_spherical_sampling(double solid_angle) {
+  return solid_angle >= min_spherical_sample_area && solid_angle <= max_spherical_sample_area;
+}
+
+// Uniform sampling of the solid angle subtended from origin by the rectangle corner + [0,1] ex +
+// [0,1] ey, with ex and ey orthogonal.
+// "An Area-Preserving Parametrization for Spherical Rectangles" (Ureña, Fajardo & King 2013).
+class SphericalRectangle {
+public:
+  SphericalRectangle(const glm::dvec3& corner, const glm::dvec3& ex, const glm::dvec3& ey, const glm::dvec3& origin);
+
+  double solid_angle() const { return area; }
+
+  // Point on the rectangle for the uniform variates u1, u2.
+  glm::dvec3 sample(double u1, double u2) const;
+
+private:
+  glm::dvec3 origin;
+  glm::dvec3 x, y, z;       ///< Local frame, z points away from the rectangle
+  double x0, x1, y0, y1, z0; ///< Rectangle extents in the local frame, z0 < 0
+  double b0, b1, k;         ///< Precomputed terms of the parametrization
+  double area = 0.0;        ///< Solid angle
+};
+
+// Uniform sampling of the solid angle subtended from origin by the triangle a, b, c.
+// "Stratified Sampling of Spherical Triangles" (Arvo 1995), as formulated in PBRT v4.
+class SphericalTriangle {
+public:
+  SphericalTriangle(const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c, const glm::dvec3& origin);
+
+  double solid_angle() const { return area; }
+
+  // Unit direction from origin towards the triangle for the uniform variates u1, u2.
+  glm::dvec3 sample(double u1, double u2) const;
+
+private:
+  glm::dvec3 a, b, c; ///< Unit directions from origin to the vertices
+  double alpha = 0.0; ///< Spherical angle at vertex a
+  double area = 0.0;  ///< Solid angle
+};
@@ -0,0 +1,88 @@
+#include "TileScheduler.hpp"
+#include "Utilities.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+  uint64_t hilbert_index(uint32_t side, uint32_t x, uint32_t y) {
+    // Distance of (x, y) along the Hilbert curve filling a side x side square, side a power of two.
+    uint64_t d = 0;
+    for (uint32_t s = side / 2; s > 0; s /= 2) {
+      uint32_t rx = (x & s) ? 1 : 0;
+      uint32_t ry = (y & s) ? 1 : 0;
+      d += uint64_t(s) * s * ((3 * rx) ^ ry);
+      // Rotate the quadrant so the curve inside it starts where the previous one ended.
+      if (ry == 0) {
+        if (rx == 1) {
+          x = side - 1 - x;
+          y = side - 1 - y;
+        }
+        std::swap(x, y);
+      }
+    }
+    return d;
+  }
+}
+
+std::vector<uint32_t> curve_order(int width, int height, TileOrder order) {
+  uint32_t side = 1;
+  while (side < uint32_t(std::max(width, height)))
+    side *= 2;
+
+  std::vector<std::pair<uint64_t, uint32_t>> keys;
+  keys.reserve(size_t(width) * height);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      uint64_t key = y * width + x;
+      if (order == TileOrder::morton) key = morton_code_2d(x, y);
+      else if (order == TileOrder::hilbert) key = hilbert_index(side, x, y);
+      keys.emplace_back(key, uint32_t(y * width + x));
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<uint32_t> cells(keys.size());
+  for (size_t k = 0; k < keys.size(); ++k)
+    cells[k] = keys[k].second;
+  return cells;
+}
+
+TileScheduler::TileScheduler(int tiles_x, int tiles_y, TileOrder order, int threads, int splits)
+  : deques(std::max(threads, 1)) {
+  splits = std::max(splits, 1);
+  for (uint32_t tile : curve_order(tiles_x, tiles_y, order))
+    for (int split = 0; split < splits; ++split)
+      units.push_back(tile * splits + split);
+
+  const size_t count = deques.size();
+  for (size_t t = 0; t < count; ++t) {
+    deques[t].begin = int(units.size() * t / count);
+    deques[t].end = int(units.size() * (t + 1) / count);
+    deques[t].victim = int((t + 1) % count);
+  }
+}
+
+int TileScheduler::next(int thread) {
+  Deque& own = deques[thread];
+  {
+    std::lock_guard lock(own.mutex);
+    if (own.begin < own.end)
+      return units[own.begin++];
+  }
+
+  // Steal the last tile of the first non-empty deque, starting from the last victim: its tiles
+  // continue the ones already stolen from it.
+  const int count = int(deques.size());
+  for (int k = 0; k < count; ++k) {
+    const int v = (own.victim + k) % count;
+    if (v == thread) continue;
+    Deque& victim = deques[v];
+    std::lock_guard lock(victim.mutex);
+    if (victim.begin < victim.end) {
+      own.victim = v;
+      return units[--victim.end];
+    }
+  }
+  return -1;
+}
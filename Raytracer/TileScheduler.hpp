@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+enum class TileOrder {
+  scanline, // Row after row
+  morton,   // Z-order curve
+  hilbert,  // Hilbert curve: consecutive tiles are always side by side
+};
+
+// Cells of a width x height grid as indices y * width + x, listed along order. Grids that aren't
+// square powers of two follow the curve of the enclosing one, skipping the cells outside.
+std::vector<uint32_t> curve_order(int width, int height, TileOrder order);
+
+// Hands out the tiles of a tiles_x x tiles_y grid to a team of threads. The tiles are listed along
+// a space filling curve and cut into one contiguous run per thread, which the thread works through
+// front to back. A thread whose run is empty steals from the back of another's, so the threads
+// that drew a cheap part of the image help with the expensive ones while each keeps working on
+// neighbouring tiles. With splits > 1 every tile is handed out splits times in a row, once per
+// part of its samples.
+class TileScheduler {
+public:
+  TileScheduler(int tiles_x, int tiles_y, TileOrder order, int threads, int splits = 1);
+
+  // Next work unit for thread, tile (y * tiles_x + x) * splits + split, or -1 once every unit has
+  // been handed out.
+  int next(int thread);
+
+  int size() const { return int(units.size()); }
+
+private:
+  // Tiles [begin, end) of the curve still owned by one thread. A tile takes far longer to render
+  // than the lock, so a mutex per deque is cheap enough. Padded to its own cache line.
+  struct alignas(64) Deque {
+    std::mutex mutex;
+    int begin = 0;
+    int end = 0;
+    int victim = 0; ///< Thread this one last stole from, tried first next time
+  };
+
+  std::vector<uint32_t> units; ///< Work units in the order they are handed out
+  std::vector<Deque> deques;
+};
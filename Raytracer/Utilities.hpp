@@ -2,29 +2,16 @@
 
 #include "Constants.hpp"
 #include "Interval.hpp"
+#include "Rng.hpp"
+#include "Sampler.hpp"
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
-#include <random>
 #include <omp.h>
 #include <glm/glm.hpp> // vec3, dot, normalize, ...
 #include <glm/gtx/norm.hpp> // length2
 
-// Utility ---------------------------------------------------------------------
-inline double rnd()
-{
-  thread_local std::mt19937_64 rng(
-    2025 +
-#ifdef _OPENMP
-    omp_get_thread_num()
-#else
-    0
-#endif
-  );
-  thread_local std::uniform_real_distribution<double> uni(0.0, 1.0);
-  return uni(rng);
-}
-
-
 // Utility Functions
 inline double degrees_to_radians(double degrees) {
   return degrees * pi / 180.0;
@@ -36,9 +23,58 @@ inline bool near_zero(const glm::dvec3& v) {
   return (fabs(v.x) < s) && (fabs(v.y) < s) && (fabs(v.z) < s);
 }
 
+inline double power_heuristic(double pdf_f, double pdf_g) {
+  // MIS weight (beta = 2) of a sample drawn from f when g could have drawn it as well.
+  double f2 = pdf_f * pdf_f;
+  double g2 = pdf_g * pdf_g;
+  return (f2 + g2) > 0.0 ? f2 / (f2 + g2) : 0.0;
+}
+
+inline float luminance(const glm::vec3& color) {
+  // Relative luminance of a linear Rec. 709 color.
+  return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+}
+
+inline uint32_t morton_code_3d(uint32_t x, uint32_t y, uint32_t z) {
+  // Interleaves the low 10 bits of x, y and z into a 30 bit Morton (Z-order) code, so points close
+  // in space tend to get close codes.
+  auto spread = [](uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+  };
+  return (spread(x) << 2) | (spread(y) << 1) | spread(z);
+}
+
+inline uint32_t morton_code_2d(uint32_t x, uint32_t y) {
+  // Interleaves the low 16 bits of x and y into a 32 bit Morton (Z-order) code.
+  auto spread = [](uint32_t v) {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+  };
+  return (spread(y) << 1) | spread(x);
+}
+
 inline double random_double() {
-  // Returns a random real in [0, 1).
-  return rand() / (RAND_MAX + 1.0);
+  // Returns a random real in [0, 1): the next dimension of the current pixel sample when a sampler
+  // is active on this thread (see SamplerScope), otherwise from the thread's own generator.
+  if (Sampler::active) return Sampler::active->get_1d();
+  return thread_rng().uniform();
+}
+
+inline glm::dvec2 random_double_2d() {
+  // Returns two random reals in [0, 1) meant to be used together, e.g. for a direction or a point
+  // on a light: a dimension pair of the current pixel sample, stratified jointly (Sampler::get_2d()).
+  if (Sampler::active) return Sampler::active->get_2d();
+  double u1 = thread_rng().uniform();
+  return glm::dvec2(u1, thread_rng().uniform());
 }
 
 inline double random_double(double min, double max) {
@@ -59,29 +95,27 @@ inline static glm::dvec3 random(double min, double max) {
   return glm::dvec3(random_double(min, max), random_double(min, max), random_double(min, max));
 }
 
-inline glm::dvec3 random_unit_vector() {
-  while (true) {
-     glm::dvec3 p = random(-1, 1);
-     double lengsq = glm::length2(p);
-     if (1e-160 < lengsq && lengsq <= 1)
-       return glm::normalize(p);
-  }
-}
-
-inline glm::dvec3 random_in_unit_disk() {
-  while (true) {
-    glm::dvec3 p = glm::dvec3(random_double(-1.0, 1.0), random_double(-1.0, 1.0), 0.0);
-    if (glm::length2(p) < 1.0)
-      return p;
-  }
-}
-
 inline glm::dvec2 sample_disk(double u1, double u2) {
   double r = std::sqrt(u1);
   double theta = 2.0 * pi * u2;
   return glm::dvec2(r * std::cos(theta), r * std::sin(theta));
 }
 
+// The random shapes below map a fixed number of variates instead of rejection sampling, so a path
+// always draws the same sampler dimensions for them and their stratification carries over.
+inline glm::dvec3 random_unit_vector() {
+  glm::dvec2 u = random_double_2d();
+  double z = 1.0 - 2.0 * u.x;
+  double r = std::sqrt(std::max(0.0, 1.0 - z * z));
+  double phi = 2.0 * pi * u.y;
+  return glm::dvec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+inline glm::dvec3 random_in_unit_disk() {
+  glm::dvec2 u = random_double_2d();
+  return glm::dvec3(sample_disk(u.x, u.y), 0.0);
+}
+
 inline glm::dvec3 random_on_hemisphere(const glm::dvec3& normal) {
   glm::dvec3 on_unit_sphere = random_unit_vector();
   if (glm::dot(on_unit_sphere, normal) > 0.0) { // In the same hemisphere as the normal
@@ -92,8 +126,9 @@ inline glm::dvec3 random_on_hemisphere(const glm::dvec3& normal) {
 }
 
 inline glm::dvec3  random_cosine_direction() {
-  double r1 = random_double();
-  double r2 = random_double();
+  glm::dvec2 u = random_double_2d();
+  double r1 = u.x;
+  double r2 = u.y;
 
   double phi = 2 * pi * r1;
   double x = std::cos(phi) * std::sqrt(r2);